@@ -0,0 +1,53 @@
+#!/bin/bash
+
+# Startup benchmark: builds synthetic configs with an increasing number of tags
+# and times how long splitcode takes to parse and index them (a single read is processed).
+# Fails if startup time grows much faster than the number of tags.
+
+splitcode="./src/splitcode"
+bench_dir="./bench"
+sizes=(100000 1000000)
+
+generate_config() {
+  awk -v n="$1" 'BEGIN {
+    print "groups\tids\ttags\tdistances\tlocations";
+    split("A C G T", b, " ");
+    for (i = 0; i < n; i++) {
+      x = (i * 2654435761) % 4294967296; # distinct 16-mer for every i < 2^32
+      s = "";
+      for (j = 0; j < 16; j++) {
+        s = s b[(x % 4) + 1];
+        x = int(x / 4);
+      }
+      print "g" (i % 96) "\tt" i "\t" s "\t0\t0:0:16";
+    }
+  }' > "$2"
+}
+
+printf "@r\nACGTACGTACGTACGTACGT\n+\nKKKKKKKKKKKKKKKKKKKK\n" > $bench_dir/bench_read.fq
+
+times=()
+for n in "${sizes[@]}"; do
+  generate_config $n $bench_dir/bench_config_$n.txt
+  start=$(date +%s%N)
+  $splitcode -c $bench_dir/bench_config_$n.txt --nFastqs=1 -m $bench_dir/bench_mapping.txt --no-output $bench_dir/bench_read.fq > /dev/null 2>&1
+  ret=$?
+  end=$(date +%s%N)
+  if [ $ret -ne 0 ]; then
+    echo "Error: splitcode failed on the $n-tag config"
+    exit 1
+  fi
+  t=$(awk -v a=$start -v b=$end 'BEGIN { printf "%.3f", (b-a)/1e9 }')
+  times+=($t)
+  echo "$n tags: ${t}s"
+  rm -f $bench_dir/bench_config_$n.txt
+done
+
+# Tag count grows 10x; anything beyond ~25x in time indicates superlinear startup
+ratio=$(awk -v a=${times[0]} -v b=${times[1]} 'BEGIN { printf "%.1f", (a > 0 ? b/a : 0) }')
+echo "Scaling (${sizes[0]} -> ${sizes[1]} tags): ${ratio}x"
+if awk -v r=$ratio 'BEGIN { exit !(r > 25) }'; then
+  echo "Error: startup time does not scale linearly with the number of tags"
+  exit 1
+fi
+echo "Benchmark OK"
@@ -52,6 +52,285 @@ AAGCTTCCGG
 +
 I;<*,(,%#$" > $test_dir/test.fq
 
+# Reads containing the tag GATCCAGTTACGGCTA: exact, one deletion, one insertion, two deletions, an insertion and a deletion, one substitution, and none
+
+echo "@read0
+TTGATCCAGTTACGGCTAAAAA
++
+IIIIIIIIIIIIIIIIIIIIII
+@read1
+TTGATCCGTTACGGCTAAAAA
++
+IIIIIIIIIIIIIIIIIIIII
+@read2
+TTGATCCAGTCTACGGCTAAAAA
++
+IIIIIIIIIIIIIIIIIIIIIII
+@read3
+TTGATCAGTTAGGCTAAAAA
++
+IIIIIIIIIIIIIIIIIIII
+@read4
+TTGATCGCAGTTACGGTAAAAA
++
+IIIIIIIIIIIIIIIIIIIIII
+@read5
+TTGATCCACTTACGGCTAAAAA
++
+IIIIIIIIIIIIIIIIIIIIII
+@read6
+TTACGTACGTACGTACGTAAAA
++
+IIIIIIIIIIIIIIIIIIIIII" > $test_dir/test_indel.fq
+
+# 100000 reads with the tag GGCCTTAA at position 5 (to learn from), then reads with: that tag only at position 30 (outside the learned window),
+# that tag at position 5 and CATGCATGCA at its fixed location (40), and no tags
+
+yes "@read
+AAAAAGGCCTTAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII" | head -n 400000 > $test_dir/test_learn.fq
+echo "@only_outside
+AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAGGCCTTAAAAAAAAAAAAAAAAAAAAAAAA
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII
+@bound_outside
+AAAAAGGCCTTAAAAAAAAAAAAAAAAAAAAAAAAAAAAACATGCATGCAAAAAAAAAAA
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII
+@none
+AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII" >> $test_dir/test_learn.fq
+
+# 20000 reads cycling through tags at a fixed location (exact, with a mismatch, at the wrong location, and the same start with a different end)
+
+yes "@read0
+GGCCTTAACGTACGTACGTACGTA
++
+IIIIIIIIIIIIIIIIIIIIIIII
+@read1
+GGCATTAATTTTGGGGCCCCAAAA
++
+IIIIIIIIIIIIIIIIIIIIIIII
+@read2
+CATGCATGGGCCTTAACCCCAAAA
++
+IIIIIIIIIIIIIIIIIIIIIIII
+@read3
+TTTTTTTTGGCCTTAACCCCAAAA
++
+IIIIIIIIIIIIIIIIIIIIIIII
+@read4
+GGCCTTAATTTTTTTTTTTTTTTT
++
+IIIIIIIIIIIIIIIIIIIIIIII" | head -n 80000 > $test_dir/test_cache.fq
+
+# 7 barcodes (GCTAAAGACAAT and GCTCAAGAGAAT differ at 2 positions), each with 0 to 3 mismatches, then reads with an N and a read 1 mismatch from both of those two
+
+echo "@read0
+GCTAAAGACAATACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read1
+GCTAGAGACAATACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read2
+GCTAAAGACACAACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read3
+GCTAGAGACGAGACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read4
+TACATAACATACACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read5
+TACATAACATAGACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read6
+TACATGACATCCACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read7
+TAGATCACAAACACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read8
+ACGTCAGCACGAACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read9
+ACGCCAGCACGAACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read10
+ACCCCAGCACGAACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read11
+AGTTCAGGACGAACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read12
+AACTTGTTGGCCACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read13
+AACTAGTTGGCCACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read14
+AACTTGCTTGCCACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read15
+AACTTAATGGCAACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read16
+CAGTGTGAATCGACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read17
+CAATGTGAATCGACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read18
+CAGAGTGAATAGACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read19
+CAATGTGGACCGACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read20
+CTTAAGGGTTAAACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read21
+CTCAAGGGTTAAACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read22
+CTTAATGGGTAAACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read23
+CTGAATGGGTAAACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read24
+GCTCAAGAGAATACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read25
+GCTCAAGAGAAAACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read26
+GCTCAAGTGAGTACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read27
+GCTCAAAAGATCACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read28
+TACATNACATACACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read29
+ACGTCNGCACGCACGTACGT
++
+IIIIIIIIIIIIIIIIIIII
+@read30
+GCTCAAGACAATACGTACGT
++
+IIIIIIIIIIIIIIIIIIII" > $test_dir/test_whitelist.fq
+
+# Tags searched at the same positions as shorter partial or unbound tags (they're reached by expanding from the shorter k-mers)
+
+echo "@r0
+TCGATCGTTATATAGGGACCTTAGCATTACGGATTACGA
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII
+@r1
+GGGATCGGGTCTCAGTCCTTAGCATTACGGATTACGAC
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII
+@r2
+GGACCTTAGCATTACGGATTACGACAGGTTCGATCGTTA
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII
+@r3
+TCGATCGTTATATAGGGTCGGGTCTCAGTCCGGATTACG
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII" > $test_dir/test_expand.fq
+echo "@r0
+AAACACCTTAATTTTGGTTTCTCGCAGTATTCCCAGGGAT
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII
+@r1
+AAACACCTTAATTTTGGTTTCTCGCAGTATTCCCAGCTAC
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII" > $test_dir/test_expand_R1.fq
+echo "@r0
+CTTAATCAATCACACCTAGTTTTAAGAAAATATTACATCG
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII
+@r1
+CTTAATCAATCAAACACCAGTTTTAAGAAAATATTACATCG
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII" > $test_dir/test_expand_R2.fq
+
+# AATAAGT at 9 onwards, with runs of 3 to 9 A's (r1 has no run of 5 or more, r3 has a run of 5 before AATAAGT)
+
+echo "@r0
+CAGATTTTCAAAAAAAAAAGAAAATCTACTTCGCCTGATA
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII
+@r1
+TCGGTTATCTTCGGATAAATAAGTGTCCCAAAAGGTGATC
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII
+@r2
+AATAAGTGAGAAAAAAGAAAATAGCGACGGACCGCGGTGT
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII
+@r3
+CGAGCTACATCAAAAATCAAATAAGTAGAAGGCTGCAACT
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII
+@r4
+GACTCTATGAATAAGTCGCGTCGATGTCAAAAAAAAAGGG
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII
+@r5
+TCAGATATCCGATACAGGGATGAAGAAATAAAAAAATCCC
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII
+@r6
+GGTGAAAAAAGGTTGTAAGTAGCTGGCCGCCGAGATAGCT
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII
+@r7
+GCGAAAATAAGTAAAAGGTTCAGACCCAAAAAAAAAGCCG
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII
+@r8
+CGATTGTTATGCGTATAAGAAAAAAAAACTACGTCCGTTC
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII
+@r9
+GCAAGCCGGGAATAAGTCGAAAAAATCAAGAGACATCTTT
++
+IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII" > $test_dir/test_polymer.fq
+
 
 # Adapter trimming tests
 
@@ -61,3 +340,39 @@ echo "0.33"
 $splitcode --trim-only -b CCAAA --partial5=3:0.33 --left=1 --pipe $test_dir/test.fq
 
 checkcmdoutput "$splitcode --trim-only -b CCAAA --partial5=3:0.35 --left=1 --pipe $test_dir/test.fq" b637fbabe71eb90bb9b3399a17eabef7
+
+# Alignment tests (align uses the total edit distance, so it also finds read4 and read5, which neighbors with 0:2:2 doesn't)
+
+checkcmdoutput "$splitcode -b GATCCAGTTACGGCTA -d 0:2:2 -i t -W align --pipe --mod-names --seq-names --mapping=/dev/null --nFastqs=1 $test_dir/test_indel.fq" b4374f9f4321fc4d8ec964f186cd75bc
+
+# Location learning tests (the read whose only tag is outside the learned window is searched in full, and fixed locations are always searched)
+
+checkcmdoutput "$splitcode -b GGCCTTAA,CATGCATGCA -i y,x -l 0,0:40:50 --learn=1000:2 --pipe --mod-names --mapping=/dev/null --nFastqs=1 $test_dir/test_learn.fq | tail -n 16" bdd64cdf1d558cd657f0fbee6b199ab9
+
+# Result cache tests (the output must be the same with and without the cache)
+
+checkcmdoutput "$splitcode -b GGCCTTAA,CATGCATG -i a,b -l 0:0:8,0:0:8 -d 1,1 --pipe --mod-names --seq-names --mapping=/dev/null --nFastqs=1 $test_dir/test_cache.fq" b37ac76fcfa57d488f39c373e442b867
+checkcmdoutput "$splitcode -b GGCCTTAA,CATGCATG -i a,b -l 0:0:8,0:0:8 -d 1,1 --cache=64 --pipe --mod-names --seq-names --mapping=/dev/null --nFastqs=1 $test_dir/test_cache.fq" b37ac76fcfa57d488f39c373e442b867
+
+# Whitelist matching tests (the output must be the same as with neighbors)
+
+checkcmdoutput "$splitcode -b GCTAAAGACAAT,TACATAACATAC,ACGTCAGCACGA,AACTTGTTGGCC,CAGTGTGAATCG,CTTAAGGGTTAA,GCTCAAGAGAAT -i a,b,c,d,e,f,g -l 0:0:12,0:0:12,0:0:12,0:0:12,0:0:12,0:0:12,0:0:12 -d 1,1,1,1,1,1,1 -W neighbors,neighbors,neighbors,neighbors,neighbors,neighbors,neighbors --pipe --mod-names --seq-names --mapping=/dev/null --nFastqs=1 $test_dir/test_whitelist.fq" fd0c3bb10d93f164d54d602782350221
+checkcmdoutput "$splitcode -b GCTAAAGACAAT,TACATAACATAC,ACGTCAGCACGA,AACTTGTTGGCC,CAGTGTGAATCG,CTTAAGGGTTAA,GCTCAAGAGAAT -i a,b,c,d,e,f,g -l 0:0:12,0:0:12,0:0:12,0:0:12,0:0:12,0:0:12,0:0:12 -d 1,1,1,1,1,1,1 -W whitelist,whitelist,whitelist,whitelist,whitelist,whitelist,whitelist --pipe --mod-names --seq-names --mapping=/dev/null --nFastqs=1 $test_dir/test_whitelist.fq" fd0c3bb10d93f164d54d602782350221
+checkcmdoutput "$splitcode -b GCTAAAGACAAT,TACATAACATAC,ACGTCAGCACGA,AACTTGTTGGCC,CAGTGTGAATCG,CTTAAGGGTTAA,GCTCAAGAGAAT -i a,b,c,d,e,f,g -l 0:0:12,0:0:12,0:0:12,0:0:12,0:0:12,0:0:12,0:0:12 -d 2,2,2,2,2,2,2 -W neighbors,neighbors,neighbors,neighbors,neighbors,neighbors,neighbors --pipe --mod-names --seq-names --mapping=/dev/null --nFastqs=1 $test_dir/test_whitelist.fq" 117d816884440e6c324b3851674608ab
+checkcmdoutput "$splitcode -b GCTAAAGACAAT,TACATAACATAC,ACGTCAGCACGA,AACTTGTTGGCC,CAGTGTGAATCG,CTTAAGGGTTAA,GCTCAAGAGAAT -i a,b,c,d,e,f,g -l 0:0:12,0:0:12,0:0:12,0:0:12,0:0:12,0:0:12,0:0:12 -d 2,2,2,2,2,2,2 -W whitelist,whitelist,whitelist,whitelist,whitelist,whitelist,whitelist --pipe --mod-names --seq-names --mapping=/dev/null --nFastqs=1 $test_dir/test_whitelist.fq" 117d816884440e6c324b3851674608ab
+
+# Mixed-radix barcode ID tests (the ODD group has a maxFindsG of 2; the mapping must be the same with 1 and 4 threads)
+
+checkcmdoutput "$splitcode -c $test_dir/splitcode_example_config.txt --nFastqs=2 --radix-ids -t 1 --no-output --mapping=/dev/stdout $test_dir/A_1.fastq.gz $test_dir/A_2.fastq.gz" 042ed34d075b6288c83add3b960e13c2
+checkcmdoutput "$splitcode -c $test_dir/splitcode_example_config.txt --nFastqs=2 --radix-ids -t 4 --no-output --mapping=/dev/stdout $test_dir/A_1.fastq.gz $test_dir/A_2.fastq.gz" 042ed34d075b6288c83add3b960e13c2
+
+# Expansion tests (every tag must still be found when shorter partial or unbound k-mers are searched at the same positions)
+
+checkcmdoutput "$splitcode -b TCGATCGTTATATA,TCGGGTCTCAGT -i t1,t2 -l 0:0:14,0:4:34 --partial3=3:0,0 --pipe --mod-names --seq-names --mapping=/dev/null --nFastqs=1 $test_dir/test_expand.fq" a993b5c6197fcb11aba8bc655169c51c
+checkcmdoutput "$splitcode -b AAACACC,CTACTAC -i t0,p0 -d 2,1 -l 1:7,-1 --partial3=0,3:0.2 --pipe --mod-names --seq-names --mapping=/dev/null --nFastqs=2 $test_dir/test_expand_R1.fq $test_dir/test_expand_R2.fq" 0054d510a2e2d49109f29d85a37e2bdb
+checkcmdoutput "$splitcode -b AAACACC,GGG,GGGGGGG -i t0,p0,p1 -d 2,0,0 -l 1:7,-1,-1 --pipe --mod-names --seq-names --mapping=/dev/null --nFastqs=2 $test_dir/test_expand_R1.fq $test_dir/test_expand_R2.fq" 3ffe84145475924aad3c43de2aeeae25
+
+# Homopolymer tests (A:5-8 must give the same output as listing the four runs, and AATAAGT must still be found past a run)
+
+checkcmdoutput "$splitcode -b AATAAGT,A:5-8 -i t1,p -l 0:9,-1 --pipe --mod-names --seq-names --mapping=/dev/null --nFastqs=1 $test_dir/test_polymer.fq" 3dd9158d2d1ecadeeda3005d1d5b9daf
+checkcmdoutput "$splitcode -b AATAAGT,AAAAA,AAAAAA,AAAAAAA,AAAAAAAA -i t1,p,p,p,p -l 0:9,-1,-1,-1,-1 --pipe --mod-names --seq-names --mapping=/dev/null --nFastqs=1 $test_dir/test_polymer.fq" 3dd9158d2d1ecadeeda3005d1d5b9daf
@@ -73,6 +73,9 @@ int64_t ProcessReads(MasterProcessor& MP, const  ProgramOptions& opt) {
       std::cerr << ", " << pretty_num(nummapped) << " reads were assigned";
     }
     std::cerr << std::endl;
+    if (MP.sc.getCacheLookups() != 0) {
+      std::cerr << "* result cache hit rate: " << std::fixed << std::setprecision(1) << (100.0*MP.sc.getCacheHits())/MP.sc.getCacheLookups() << "%" << std::endl;
+    }
   }
   
   MP.sc.setNumReads(numreads);
@@ -336,7 +339,7 @@ void MasterProcessor::writeOutput(std::vector<SplitCode::Results>& rv,
 }
 
 ReadProcessor::ReadProcessor(const ProgramOptions& opt, MasterProcessor& mp) : 
-  mp(mp), numreads(0) {
+  mp(mp), numreads(0), cache(opt.cache_size) {
    // initialize buffer
    bufsize = mp.bufsize;
    buffer = new char[bufsize];
@@ -357,7 +360,9 @@ ReadProcessor::ReadProcessor(ReadProcessor && o) :
   names(std::move(o.names)),
   quals(std::move(o.quals)),
   flags(std::move(o.flags)),
-  full(o.full) {
+  full(o.full),
+  cache(std::move(o.cache)),
+  matcher(std::move(o.matcher)) {
     buffer = o.buffer;
     o.buffer = nullptr;
     o.bufsize = 0;
@@ -419,49 +424,25 @@ void ReadProcessor::operator()() {
 void ReadProcessor::processBuffer() {
   // actually process the sequence
   
-  int incf, jmax, nfiles;
-  nfiles = mp.nfiles;
-  incf = nfiles-1;
-  jmax = nfiles;
-
-  std::vector<const char*> s(jmax, nullptr);
-  std::vector<int> l(jmax,0);
-  std::vector<const char*> q(full ? jmax : 0, nullptr);
+  int jmax = mp.nfiles;
+  size_t n = seqs.size() / jmax;
+  mp.sc.processBatch(seqs, quals, jmax, rv, full, &cache, &matcher);
+  numreads += n;
 
+  if (numreads >= 1000000 && mp.verbose) { 
+      numreads = 0; // reset counter
+      int nummapped = mp.sc.getNumMapped();
 
-  for (int i = 0; i + incf < seqs.size(); i++) {
-    for (int j = 0; j < jmax; j++) {
-      s[j] = seqs[i+j].first;
-      l[j] = seqs[i+j].second;      
-      if (full) {
-        q[j] = quals[i+j].first;
+      std::cerr << '\r' << (mp.numreads/1000000) << "M reads processed";
+      if (!mp.sc.always_assign) {
+        std::cerr << " (" 
+          << std::fixed << std::setw( 3 ) << std::setprecision( 1 ) << ((100.0*nummapped)/double(mp.numreads))
+          << "% assigned)";
+      } else {
+        std::cerr << " (running in --trim-only mode)";
       }
+      std::cerr.flush();
     }
-    i += incf;
-    numreads++;
-    
-    SplitCode::Results results;
-    mp.sc.processRead(s, l, jmax, results, q);
-    if (mp.sc.isAssigned(results)) { // Only modify/trim the reads stored in seq if assigned
-      mp.sc.modifyRead(seqs, quals, i-incf, results, true);
-    }
-    rv.push_back(results);
-
-    if (numreads > 0 && numreads % 1000000 == 0 && mp.verbose) { 
-        numreads = 0; // reset counter
-        int nummapped = mp.sc.getNumMapped();
-
-        std::cerr << '\r' << (mp.numreads/1000000) << "M reads processed";
-        if (!mp.sc.always_assign) {
-          std::cerr << " (" 
-            << std::fixed << std::setw( 3 ) << std::setprecision( 1 ) << ((100.0*nummapped)/double(mp.numreads))
-            << "% assigned)";
-        } else {
-          std::cerr << " (running in --trim-only mode)";
-        }
-        std::cerr.flush();
-      }
-  }
 }
 
 void ReadProcessor::clear() {
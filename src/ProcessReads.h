@@ -309,6 +309,8 @@ public:
   
   std::vector<SplitCode::Results> rv;
   bool full;
+  SplitCode::ResultCache cache;
+  SplitCode::Matcher matcher;
   
   /*std::vector<std::vector<int>> newIDs;
   std::vector<std::vector<int>> IDs;*/
@@ -7,6 +7,7 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <list>
 #include <unordered_map>
 #include <set>
 #include <algorithm>
@@ -16,12 +17,20 @@
 #include <limits>
 #include <stack>
 #include <cmath>
+#include <cstdlib>
 #include <iomanip>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <iterator>
+#include <chrono>
 #include "robin_hood.h"
 
 struct SplitCode {
   typedef std::pair<uint32_t,short> tval; // first element of pair is tag id, second is mismatch distance
   enum dir {left, right, nodir};
+  enum matcher {match_neighbors, match_align, match_whitelist}; // How a tag's errors are matched: enumerated neighbors in the tags map, alignment, or a whitelist index
+  enum probe_type {probe_align, probe_partial5, probe_partial3, probe_polymer, probe_whitelist}; // Tags matched at probe time rather than through the tags map
   
   SplitCode() {
     init = false;
@@ -31,9 +40,18 @@ struct SplitCode {
     keep_check_group = false;
     always_assign = false;
     random_replacement = false;
+    radix_ids = false;
+    barcode_id_len = FAKE_BARCODE_LEN;
+    discarded_unused = false;
+    keep_pruning = false;
+    plan_size = 0;
+    plan_compile_time = 0;
     do_extract = false;
     extract_no_chain = false;
     use_16 = false;
+    use_file_caps = false;
+    n_min_finds = 0;
+    count_finds = false;
     n_tag_entries = 0;
     curr_barcode_mapping_i = 0;
     curr_umi_id_i = 0;
@@ -47,6 +65,14 @@ struct SplitCode {
     num_reads_assigned = 0;
     summary_n_reads_filtered = 0;
     summary_n_reads_filtered_assigned = 0;
+    learn_n = 0;
+    learn_margin = 0;
+    learn_n_seen = 0;
+    learned = false;
+    learn_n_fallback = 0;
+    results_cacheable = false;
+    cache_n_hits = 0;
+    cache_n_lookups = 0;
     setNFiles(0);
   }
   
@@ -60,7 +86,14 @@ struct SplitCode {
     discard_check_group = false;
     keep_check_group = false;
     do_extract = false;
+    radix_ids = false;
+    barcode_id_len = FAKE_BARCODE_LEN;
+    discarded_unused = false;
+    keep_pruning = false;
     use_16 = false;
+    use_file_caps = false;
+    n_min_finds = 0;
+    count_finds = false;
     n_tag_entries = 0;
     curr_barcode_mapping_i = 0;
     curr_umi_id_i = 0;
@@ -68,6 +101,14 @@ struct SplitCode {
     num_reads_assigned = 0;
     summary_n_reads_filtered = 0;
     summary_n_reads_filtered_assigned = 0;
+    learn_n = 0;
+    learn_margin = 0;
+    learn_n_seen = 0;
+    learned = false;
+    learn_n_fallback = 0;
+    results_cacheable = false;
+    cache_n_hits = 0;
+    cache_n_lookups = 0;
     this->summary_file = summary_file;
     this->trim_5_str = trim_5_str;
     this->trim_3_str = trim_3_str;
@@ -256,10 +297,49 @@ struct SplitCode {
          << "}" << ((umi_index == umi_names.size()-1) ? "\n" : ",\n");
     }
     of << "\t" << "]," << "\n";
+    if (cache_n_lookups != 0) {
+      of << "\t" << "\"result_cache_info\": " << "{" << "\n";
+      of << "\t\t" << "\"n_lookups\": " << cache_n_lookups << ",\n";
+      of << "\t\t" << "\"n_hits\": " << cache_n_hits << ",\n";
+      of << "\t\t" << "\"hit_rate\": " << std::fixed << std::setprecision(3) << (cache_n_hits / static_cast<double>(cache_n_lookups)) << "\n";
+      of << "\t" << "}," << "\n";
+    }
+    if (learn_n != 0) {
+      of << "\t" << "\"location_learning_info\": " << "{" << "\n";
+      of << "\t\t" << "\"n_reads_learned\": " << learn_n_seen << ",\n";
+      of << "\t\t" << "\"n_reads_full_search\": " << learn_n_fallback << ",\n";
+      of << "\t\t" << "\"max_full_search_rate\": " << LEARN_MAX_FALLBACK_RATE << ",\n";
+      of << "\t\t" << "\"locations\": " << "[" << "\n";
+      bool summary_learn = false;
+      for (int i = 0; i < (int)learn_hist.size(); i++) {
+        auto window = learnedWindow(i, 0);
+        if (window.first == -1) {
+          continue;
+        }
+        if (summary_learn) {
+          of << ",\n";
+        }
+        summary_learn = true;
+        size_t n_found = 0;
+        for (auto n : learn_hist[i]) {
+          n_found += n;
+        }
+        size_t n_searched = i < (int)learn_file_searched.size() ? learn_file_searched[i] : 0;
+        size_t n_full_search = i < (int)learn_file_fallback.size() ? learn_file_fallback[i] : 0;
+        of << "\t\t\t" << "{ \"file\": " << i << ", \"start\": " << window.first << ", \"end\": " << histogramRange(learn_hist_end[i]).second
+           << ", \"n_found\": " << n_found << ", \"n_full_search\": " << n_full_search
+           << ", \"full_search_rate\": " << std::fixed << std::setprecision(3) << (n_searched == 0 ? 0.0 : n_full_search / static_cast<double>(n_searched))
+           << ", \"restricted\": " << (learned && learned_files[i]) << " }";
+      }
+      of << (summary_learn ? "\n" : "") << "\t\t" << "]\n";
+      of << "\t" << "}," << "\n";
+    }
     of << "\t" << "\"developer_use_info\": " << "{" << "\n";
       of << "\t\t" << "\"tags_vector_size\": " << getNumTags() << ",\n";
       of << "\t\t" << "\"tags_map_size\": " << getMapSize() << ",\n";
       of << "\t\t" << "\"num_elements_in_tags_map\": " << getMapSize(false) << ",\n";
+      of << "\t\t" << "\"search_plan_size\": " << plan_size << ",\n";
+      of << "\t\t" << "\"search_plan_compile_time\": " << std::fixed << std::setprecision(3) << plan_compile_time << ",\n";
       of << "\t\t" << "\"always_assign\": " << always_assign << "\n";
     of << "\t" << "}" << "\n";
     of << "}" << std::endl;
@@ -304,6 +384,28 @@ struct SplitCode {
     this->always_assign = trim_only;
   }
   
+  void setLearning(size_t n_reads, int margin) {
+    if (init) {
+      return;
+    }
+    this->learn_n = n_reads;
+    this->learn_margin = margin;
+  }
+  
+  void setDiscardedUnused(bool discarded_unused) { // Set when discarded reads aren't written out anywhere (so their search may stop early)
+    if (init) {
+      return;
+    }
+    this->discarded_unused = discarded_unused;
+  }
+  
+  void setRadixIds(bool radix_ids) {
+    if (init) {
+      return;
+    }
+    this->radix_ids = radix_ids;
+  }
+  
   void setRandomReplacement(bool rand) {
     if (init) {
       return;
@@ -311,6 +413,69 @@ struct SplitCode {
     this->random_replacement = rand;
   }
   
+  bool setupRadixIds() { // Checks the tags for mixed-radix barcode IDs and lays out their digits (false if they can't be used)
+    // Final barcode IDs are mixed-radix numbers with maxFindsG digits per group (digit 0 = no more found from that group)
+    if (idmap_getsize() != 0) {
+      std::cerr << "Error: Mixed-radix barcode IDs cannot be used when adding on to an existing mapping" << std::endl;
+      return false;
+    }
+    std::vector<uint32_t> name_group(names.size(), -1);
+    std::vector<std::vector<uint32_t>> group_members(group_names.size());
+    for (auto& tag : tags_vec) {
+      if (tag.not_include_in_barcode) {
+        continue;
+      }
+      if (max_finds_group_map.find(tag.group) == max_finds_group_map.end()) {
+        std::cerr << "Error: Mixed-radix barcode IDs require the tag \"" << names[tag.name_id] << "\" to be in a group with a maxFindsG" << std::endl;
+        return false;
+      }
+      if (name_group[tag.name_id] == (uint32_t)-1) {
+        name_group[tag.name_id] = tag.group;
+        group_members[tag.group].push_back(tag.name_id);
+      } else if (name_group[tag.name_id] != tag.group) {
+        std::cerr << "Error: Mixed-radix barcode IDs require the tag name \"" << names[tag.name_id] << "\" to belong to only one group" << std::endl;
+        return false;
+      }
+    }
+    radix_digits.assign(names.size(), std::make_pair(0, 0));
+    radix_groups.clear();
+    uint64_t place = 1;
+    for (int g = 0; g < (int)group_members.size(); g++) {
+      auto& members = group_members[g];
+      if (members.empty()) {
+        continue;
+      }
+      std::sort(members.begin(), members.end());
+      for (int j = 0; j < (int)members.size(); j++) {
+        radix_digits[members[j]] = std::make_pair(radix_groups.size()+1, j+1);
+      }
+      RadixGroup radix_group;
+      radix_group.members = members;
+      for (int d = 0; d < max_finds_group_map[g]; d++) { // One digit for each tag the group can have found (in the order found)
+        radix_group.places.push_back(place);
+        if (place > std::numeric_limits<uint64_t>::max()/(members.size()+1)) {
+          place = 0; // (Too many)
+          break;
+        }
+        place *= members.size()+1;
+      }
+      radix_groups.push_back(radix_group);
+      if (place == 0) {
+        break;
+      }
+    }
+    // IDs that don't fit in the usual final barcode get a longer one
+    while (place != 0 && barcode_id_len < 32 && ((place-1) >> (2*barcode_id_len)) != 0) {
+      barcode_id_len++;
+    }
+    if (place == 0 || ((place-1) >> (2*barcode_id_len)) != 0 || barcode_id_len+barcode_prefix.length() > 32) {
+      std::cerr << "Error: Too many combinations of tag groups for mixed-radix barcode IDs" << std::endl;
+      radix_groups.clear();
+      return false;
+    }
+    return true;
+  }
+  
   void checkInit() { // Initialize if necessary (once initialized, can't add any more barcode tags)
     if (init) {
       return;
@@ -358,6 +523,21 @@ struct SplitCode {
         exit(1);
       }
       do_extract = true;
+      // Flatten the UMIs extracted at each tag name and then at each group into one table
+      umi_actions.clear();
+      auto flatten = [this](const std::unordered_map<uint32_t,std::vector<UMI>>& umi_map, size_t n, std::vector<uint32_t>& start) {
+        start.assign(n+1, 0);
+        for (size_t i = 0; i < n; i++) {
+          start[i] = umi_actions.size();
+          auto it = umi_map.find(i);
+          if (it != umi_map.end()) {
+            umi_actions.insert(umi_actions.end(), it->second.begin(), it->second.end());
+          }
+        }
+        start[n] = umi_actions.size();
+      };
+      flatten(umi_name_map, names.size(), umi_name_start);
+      flatten(umi_group_map, group_names.size(), umi_group_start);
     }
     // Process barcode prefix
     if (!barcode_prefix.empty()) {
@@ -417,19 +597,13 @@ struct SplitCode {
       if (s[1] == '{') {
         name = s.substr(2,s.find_first_of('}')-2);
         group = true;
-        const auto& itnames = std::find(group_names.begin(), group_names.end(), name);
-        if (itnames == group_names.end()) {
+        if (!getGroupId(name, id)) {
           continue;
-        } else {
-          id = itnames - group_names.begin();
         }
       } else {
         name = s.substr(1,s.find_first_of('}')-1);
-        const auto& itnames = std::find(names.begin(), names.end(), name);
-        if (itnames == names.end()) {
+        if (!getNameId(name, id)) {
           continue;
-        } else {
-          id = itnames - names.begin();
         }
       }
       uint16_t extra = 0;
@@ -466,84 +640,60 @@ struct SplitCode {
     before_after_vec.shrink_to_fit();
     // Fill in k-mer sizes by location (e.g. search for k-mers of length n at positions a-b in file c):
     // (we have to be sure to merge overlapping intervals and having intervals in sorted order which is what most of what the code below does)
+    auto plan_start = std::chrono::steady_clock::now();
     int POS_MAX = std::numeric_limits<std::int32_t>::max();
     std::vector<std::map<int,std::vector<std::pair<int,int>>>> kmer_map_vec; // key = k-mer size, value = vector of position intervals; vector = one map for each file
-    for (auto x : tags) {
-      int kmer_size = x.first.length();
-      for (auto y : x.second) {
-        auto tag = tags_vec[y.first];
-        if (tag.pos_end == 0) {
-          tag.pos_end = POS_MAX;
-        }
-        std::vector<int> files(0);
-        if (tag.file == -1) {
-          kmer_map_vec.resize(nFiles);
-          for (int i = 0; i < nFiles; i++) {
-            files.push_back(i);
-          }
-        } else {
-          kmer_map_vec.resize(std::max((int)kmer_map_vec.size(),tag.file+1));
-          files.push_back(tag.file);
-        }
-        for (int f : files) {
-          auto &kmer_map = kmer_map_vec[f];
-          if (kmer_map.find(kmer_size) == kmer_map.end()) {
-            kmer_map[kmer_size] = std::vector<std::pair<int,int>>(0);
-            kmer_map[kmer_size].push_back(std::make_pair(tag.pos_start < 0 ? 0 : tag.pos_start, tag.pos_end));
-          } else {
-            // Take the union of the intervals:
-            auto& curr_intervals = kmer_map[kmer_size];
-            std::pair<int,int> new_interval = std::make_pair(tag.pos_start < 0 ? 0 : tag.pos_start, tag.pos_end);
-            bool modified = false;
-            bool update_vector = true;
-            for (auto &interval : curr_intervals) {
-              if (new_interval.second >= interval.first && new_interval.first <= interval.second) {
-                if (std::min(new_interval.first, interval.first) == interval.first && std::max(new_interval.second,interval.second) == interval.second) {
-                  update_vector = false;
-                } else {
-                  modified = true;
-                  interval = std::make_pair(std::min(new_interval.first, interval.first), std::max(new_interval.second, interval.second));
-                }
-              }
-            }
-            if (!modified) {
-              if (update_vector) {
-                curr_intervals.push_back(new_interval);
-              }
-            } else { // Existing intervals were modified so let's merge all overlapping intervals in the vector
-              std::stack<std::pair<int,int>> s;
-              std::sort(curr_intervals.begin(), curr_intervals.end(), [](std::pair<int,int> a, std::pair<int,int> b) {return a.first < b.first; });
-              s.push(curr_intervals[0]);
-              int n = curr_intervals.size();
-              for (int i = 1; i < n; i++) {
-                auto top = s.top();
-                if (top.second < curr_intervals[i].first) {
-                  s.push(curr_intervals[i]);
-                } else if (top.second < curr_intervals[i].second) {
-                  top.second = curr_intervals[i].second;
-                  s.pop();
-                  s.push(top);
-                }
-              }
-              // Convert stack to vector
-              curr_intervals.clear();
-              while (!s.empty()) {
-                curr_intervals.push_back(s.top());
-                s.pop();
-              }
-              std::sort(curr_intervals.begin(), curr_intervals.end(), [](std::pair<int,int> a, std::pair<int,int> b) {return a.first < b.first; });
-            }
-          }
-        }
+    auto add_kmer_interval = [&](const SplitCodeTag& tag, int kmer_size) { // Search for k-mers of size kmer_size within the tag's location
+      const int32_t tag_pos_end = tag.pos_end == 0 ? POS_MAX : tag.pos_end;
+      int start_file = tag.file == -1 ? 0 : tag.file;
+      int end_file = tag.file == -1 ? nFiles : tag.file+1;
+      kmer_map_vec.resize(std::max((int)kmer_map_vec.size(), end_file));
+      for (int f = start_file; f < end_file; f++) {
+        kmer_map_vec[f][kmer_size].push_back(std::make_pair(tag.pos_start < 0 ? 0 : tag.pos_start, tag_pos_end)); // (Merged once all are added)
+      }
+    };
+    for (const auto& x : tags) {
+      for (const auto& y : x.second) {
+        add_kmer_interval(tags_vec[y.first], x.first.length());
       }
     }
+    for (const auto& a : align_tags) { // Aligned tags are probed with their minimum match length
+      add_kmer_interval(tags_vec[a.tag_id], a.probe_k);
+    }
+    for (const auto& p : partial_tags) { // Partial tags are probed with their minimum match length (5′ partial tags only at the start of the read)
+      auto tag = tags_vec[p.tag_id];
+      if (tag.partial5) {
+        tag.pos_start = 0;
+        tag.pos_end = p.min_match;
+      }
+      add_kmer_interval(tag, p.min_match);
+    }
+    for (auto& w : whitelists) { // Whitelisted tags are probed with their length (all tags in a whitelist share it and their location)
+      w.build();
+      add_kmer_interval(tags_vec[w.tag_ids[0]], w.m);
+    }
+    for (const auto& p : polymer_tags) { // Homopolymer tags are probed with their shortest length
+      add_kmer_interval(tags_vec[p.tag_id], p.range_begin);
+    }
     // Transfer kmer_map_vec into kmer_size_locations (which facilitates iteration while processing fastq reads in k-mers)
     kmer_size_locations.resize(nFiles);
     for (int i = 0; i < kmer_map_vec.size(); i++) {
-      auto kmer_map = kmer_map_vec[i];
-      for (auto x : kmer_map) {
+      auto& kmer_map = kmer_map_vec[i];
+      for (auto& x : kmer_map) {
         int kmer_size = x.first;
-        for (auto v : x.second) {
+        // Take the union of the intervals (intervals that touch are merged)
+        auto& intervals = x.second;
+        std::sort(intervals.begin(), intervals.end());
+        size_t n_merged = 0;
+        for (const auto& v : intervals) {
+          if (n_merged != 0 && v.first <= intervals[n_merged-1].second) {
+            intervals[n_merged-1].second = std::max(intervals[n_merged-1].second, v.second);
+          } else {
+            intervals[n_merged++] = v;
+          }
+        }
+        intervals.resize(n_merged);
+        for (auto v : intervals) {
           int start_pos = v.first;
           int end_pos = v.second;
           while (start_pos + kmer_size <= end_pos || end_pos == POS_MAX) {
@@ -560,12 +710,12 @@ struct SplitCode {
           }
         }
       }
-      // Sort kmer_size_locations[i] and ensure all elements are unique
-      std::set<std::pair<int,int>> s(kmer_size_locations[i].begin(), kmer_size_locations[i].end());
-      kmer_size_locations[i].assign(s.begin(), s.end()); // Make sure all elements are unique
-      std::sort(kmer_size_locations[i].begin(), kmer_size_locations[i].end(), [](std::pair<int,int> a, std::pair<int,int> b) {
+      // Sort kmer_size_locations[i] (by k-mer size, then position with -1 last) and ensure all elements are unique
+      auto& locs = kmer_size_locations[i];
+      std::sort(locs.begin(), locs.end(), [](std::pair<int,int> a, std::pair<int,int> b) {
         return (a.first == b.first) ? (a.second == -1 || b.second == -1 ? a.second > b.second : a.second < b.second) : (a.first < b.first);
       });
+      locs.erase(std::unique(locs.begin(), locs.end()), locs.end());
     }
     initiator_files.resize(kmer_size_locations.size(), false);
     for (int i = 0; i < tags_vec.size(); i++) { // Set up minFinds and maxFinds and initiators
@@ -584,6 +734,53 @@ struct SplitCode {
         }
       }
     }
+    group_min_finds.assign(group_names.size(), 0);
+    group_max_finds.assign(group_names.size(), 0);
+    for (auto& it : min_finds_group_map) {
+      group_min_finds[it.first] = it.second;
+    }
+    for (auto& it : max_finds_group_map) {
+      group_max_finds[it.first] = it.second;
+    }
+    n_min_finds = min_finds_map.size() + min_finds_group_map.size();
+    count_finds = !(min_finds_map.empty() && max_finds_map.empty() && min_finds_group_map.empty() && max_finds_group_map.empty());
+    // The search of a file can stop once every tag that could be found there has used up its maxFinds or maxFindsG
+    // (later finds would be skipped); files with a tag that can be found any number of times, or where skipped finds
+    // could still count toward a minFinds/minFindsG, are searched to the end
+    file_caps.assign(kmer_size_locations.size(), 0);
+    tag_caps.assign(tags_vec.size(), false);
+    group_cap_files.clear();
+    {
+      std::vector<std::set<uint32_t>> capped_groups(file_caps.size());
+      for (int i = 0; i < (int)tags_vec.size(); i++) {
+        auto& tag = tags_vec[i];
+        if (tag.file < 0 || tag.file >= (int)file_caps.size() || file_caps[tag.file] == -1) {
+          continue;
+        }
+        auto group_max = max_finds_group_map.find(tag.group);
+        auto group_min = min_finds_group_map.find(tag.group);
+        if (group_max != max_finds_group_map.end()) {
+          if (tag.min_finds > 0 || (group_min != min_finds_group_map.end() && group_min->second > group_max->second)) {
+            file_caps[tag.file] = -1;
+          } else if (capped_groups[tag.file].insert(tag.group).second) {
+            file_caps[tag.file]++;
+            group_cap_files[tag.group].push_back(tag.file);
+          }
+        } else if (tag.max_finds > 0 && group_min == min_finds_group_map.end()) {
+          tag_caps[i] = true;
+          file_caps[tag.file]++;
+        } else {
+          file_caps[tag.file] = -1;
+        }
+      }
+    }
+    use_file_caps = std::find_if(file_caps.begin(), file_caps.end(), [](int n) { return n > 0; }) != file_caps.end();
+    if (radix_ids && !setupRadixIds()) {
+      radix_ids = false; // (The error was reported; callers can check usesRadixIds() rather than have the program exit here)
+    }
+    // With a keep list, a read can be discarded as soon as what's been found can't begin any kept sequence, unless the
+    // rest of the discarded read would still be output or summarized
+    keep_pruning = (keep_check || keep_check_group) && discarded_unused && summary_file.empty() && !always_assign;
     // Decide on 16-bit vs. 32-bit int
     if (names.size() < std::numeric_limits<std::uint16_t>::max() && idmap_getsize() == 0) {
       use_16 = true;
@@ -591,117 +788,140 @@ struct SplitCode {
     // Resize certain data structures to be the size of names
     summary_tags_trimmed.resize(names.size());
     summary_tags_trimmed_assigned.resize(names.size());
-    // Set up expansions vectors (in a map with keys being k-mer sizes):
-    struct Expansion {
-      int kmer_size, kmer_size_2, start_pos, start_pos_2, file;
+    dynamic_probes.clear();
+    auto add_dynamic_probe = [&](int probe_k, probe_type type, uint32_t i) {
+      dynamic_probes.resize(std::max((int)dynamic_probes.size(), probe_k+1));
+      dynamic_probes[probe_k].push_back(std::make_pair(type, i));
     };
-    std::unordered_map<int,std::vector<Expansion>> emap;
-    for (int i = 0; i < kmer_size_locations.size(); i++) { // Go through locations to figure out where expansions may 'potentially' occur (on the basis of location)
-      int prev_kmer_size = -1;
-      int prev_start_pos = -1;
-      std::pair<int,int> max_loc = std::make_pair(-1,-1); // k-mer location with the rightmost non-(-1) location
+    for (int i = 0; i < (int)align_tags.size(); i++) {
+      add_dynamic_probe(align_tags[i].probe_k, probe_align, i);
+    }
+    for (int i = 0; i < (int)partial_tags.size(); i++) {
+      add_dynamic_probe(partial_tags[i].min_match, tags_vec[partial_tags[i].tag_id].partial5 ? probe_partial5 : probe_partial3, i);
+    }
+    for (int i = 0; i < (int)polymer_tags.size(); i++) {
+      add_dynamic_probe(polymer_tags[i].range_begin, probe_polymer, i);
+    }
+    for (int i = 0; i < (int)whitelists.size(); i++) {
+      add_dynamic_probe(whitelists[i].m, probe_whitelist, i);
+    }
+    // A k-mer size searched at the same position as a smaller one is reached by expanding from the smaller one instead
+    // (unbound k-mer sizes are searched up to the rightmost bound position, and count as being at that position)
+    std::unordered_map<int,std::map<int,std::vector<std::vector<int>>>> expansions; // [larger k][smaller k][file] -> positions (ascending)
+    std::unordered_map<int,std::map<int,std::vector<int>>> unbound_expansions; // [larger k][smaller k][file] -> position past which it's also expanded to (-1 if none)
+    for (int i = 0; i < (int)kmer_size_locations.size(); i++) {
+      auto& locs = kmer_size_locations[i];
+      int max_pos = -1; // The rightmost bound position
       int smallest_kmer_unbound = -1; // the smallest k-mer size with a -1 location
-      for (auto &loc : kmer_size_locations[i]) {
+      for (const auto& loc : locs) {
         if (smallest_kmer_unbound == -1 && loc.second == -1) {
           smallest_kmer_unbound = loc.first;
         }
-        if (loc.second > max_loc.second) {
-          max_loc.first = loc.first; // max_loc.first will be the smallest k if there are ties
-          max_loc.second = loc.second;
-        }
-      }
-      if (max_loc.second != -1) {
-        // Extend all -1's to max_loc
-        int prev_k = -1;
-        int prev_pos = -1;
-        for (int j = 0; j < kmer_size_locations[i].size(); j++) {
-          if (kmer_size_locations[i][j].second == -1) {
-            int k = kmer_size_locations[i][j].first;
-            int pos = kmer_size_locations[i][j].second;
-            if (pos == -1 && prev_k != -1 && k == prev_k && prev_pos != -1) {
-              auto &v = kmer_size_locations[i];
-              std::vector<std::pair<int,int>> new_v;
-              for (int p = prev_pos+1; p <= max_loc.second; p++) {
-                new_v.push_back(std::make_pair(k,p));
-              }
-              v.insert(v.begin()+j,new_v.begin(),new_v.end());
-              j += new_v.size();
-            }
+        max_pos = std::max(max_pos, loc.second);
+      }
+      // Extend all -1's to max_pos
+      std::vector<std::pair<int,int>> extended;
+      extended.reserve(locs.size());
+      for (int j = 0; j < (int)locs.size(); j++) {
+        if (locs[j].second == -1 && j > 0 && locs[j-1].first == locs[j].first && locs[j-1].second != -1) {
+          for (int p = locs[j-1].second+1; p <= max_pos; p++) {
+            extended.push_back(std::make_pair(locs[j].first, p));
           }
-          prev_k = kmer_size_locations[i][j].first;
-          prev_pos = kmer_size_locations[i][j].second;
         }
-      }
-      std::set<std::pair<int,int>> deletions;
-      for (int j = 0; j < kmer_size_locations[i].size(); j++) {
-        int kmer_size = kmer_size_locations[i][j].first;
-        int start_pos = kmer_size_locations[i][j].second;
-        int prev_kmer_size_2 = -1;
-        int prev_start_pos_2 = -1;
-        for (int k = j+1; k < kmer_size_locations[i].size(); k++) {
-          int kmer_size_2 = kmer_size_locations[i][k].first;
-          int start_pos_2 = kmer_size_locations[i][k].second;
-          if (kmer_size_2 <= kmer_size) {
-            continue;
-          }
-          int actual_start_pos_2 = start_pos_2 == -1 && prev_start_pos_2 != -1 && prev_kmer_size_2 != -1 && prev_kmer_size_2 == kmer_size_2 ? prev_start_pos_2 : start_pos_2;
-          int actual_start_pos = start_pos == -1 && prev_start_pos != -1 && prev_kmer_size != -1 && prev_kmer_size == kmer_size ? prev_start_pos : start_pos;
-          // If we can expand from kmer_size to kmer_size_2:
-          if (((start_pos == -1 || start_pos_2 == -1) && ((actual_start_pos_2 == -1 || actual_start_pos == -1) || (actual_start_pos_2 == actual_start_pos))) 
-                || (start_pos != -1 && start_pos_2 != -1 && start_pos_2 == start_pos)) {
-            Expansion e;
-            e.kmer_size = kmer_size;
-            e.kmer_size_2 = kmer_size_2;
-            e.start_pos = actual_start_pos;
-            e.start_pos_2 = actual_start_pos_2;
-            e.file = i;
-            emap[kmer_size_2].push_back(e);
-            if (!(smallest_kmer_unbound == e.kmer_size_2 && start_pos_2 == -1)) {
-              deletions.insert(std::make_pair(e.kmer_size_2, start_pos_2)); // Mark location with larger k-mer for deletion (since we can expand to it)
-            }
+        extended.push_back(locs[j]);
+      }
+      // Group the k-mer sizes by position
+      std::vector<std::pair<int,int>> at_pos; // (position, k-mer size)
+      at_pos.reserve(extended.size());
+      for (const auto& loc : extended) {
+        at_pos.push_back(std::make_pair(loc.second == -1 ? max_pos : loc.second, loc.first));
+      }
+      std::sort(at_pos.begin(), at_pos.end());
+      at_pos.erase(std::unique(at_pos.begin(), at_pos.end()), at_pos.end());
+      std::unordered_map<int,int> smallest_k; // Position -> smallest k-mer size searched there
+      for (size_t a = 0, b; a < at_pos.size(); a = b) {
+        int pos = at_pos[a].first;
+        smallest_k[pos] = at_pos[a].second;
+        for (b = a; b < at_pos.size() && at_pos[b].first == pos; b++) {
+          for (size_t c = a; c < b; c++) {
+            auto& files = expansions[at_pos[b].second][at_pos[c].second];
+            files.resize(kmer_size_locations.size());
+            files[i].push_back(pos);
           }
-          prev_kmer_size_2 = kmer_size_2;
-          prev_start_pos_2 = start_pos_2;
         }
-        prev_kmer_size = kmer_size;
-        prev_start_pos = start_pos;
       }
-      // Delete marked locations
-      for (auto d : deletions) {
-        kmer_size_locations[i].erase(std::remove(kmer_size_locations[i].begin(), kmer_size_locations[i].end(), d), kmer_size_locations[i].end());
+      std::vector<int> unbound_k; // Unbound k-mer sizes are also expanded to from smaller unbound ones at every position past max_pos
+      for (const auto& loc : locs) {
+        if (loc.second == -1) {
+          for (int smaller : unbound_k) {
+            auto& files = unbound_expansions[loc.first][smaller];
+            files.resize(kmer_size_locations.size(), -1);
+            files[i] = max_pos;
+          }
+          unbound_k.push_back(loc.first);
+        }
       }
-      // Find the -1 position (if it exists) and make sure it's preceded by max_loc.second+1
-      auto it = std::find(kmer_size_locations[i].begin(), kmer_size_locations[i].end(), std::pair<int,int>(smallest_kmer_unbound, -1));
-      if (it != kmer_size_locations[i].end()) {
-        kmer_size_locations[i].insert(it, std::pair<int,int>(smallest_kmer_unbound, max_loc.second+1));
+      // Delete the locations that are expanded to
+      locs.clear();
+      for (const auto& loc : extended) {
+        if (loc.first == smallest_k[loc.second == -1 ? max_pos : loc.second] || (loc.first == smallest_kmer_unbound && loc.second == -1)) {
+          if (loc.first == smallest_kmer_unbound && loc.second == -1) {
+            locs.push_back(std::make_pair(smallest_kmer_unbound, max_pos+1)); // The -1 position is preceded by max_pos+1
+          }
+          locs.push_back(loc);
+        }
       }
       // Sort by location (aka the second element in the pair) rather than by k-mer size
-      std::sort(kmer_size_locations[i].begin(), kmer_size_locations[i].end(), [](std::pair<int,int> a, std::pair<int,int> b) {
+      std::sort(locs.begin(), locs.end(), [](std::pair<int,int> a, std::pair<int,int> b) {
         return (a.second == -1 || b.second == -1 ? a.second > b.second : a.second < b.second);
       });
+      auto unbound_it = std::find_if(locs.begin(), locs.end(), [](std::pair<int,int> a) { return a.second == -1; });
+      std::sort(unbound_it, locs.end()); // Unbound k-mers are swept together in ascending k order
     }
     // For all sequences in map, decompose them into smaller substrings
-    std::set<std::pair<std::string,int>> decomposed_kmers;
+    std::set<std::pair<std::string,int>> decomposed_from; // (sequence, smaller k-mer size it's expanded from)
     for (auto& it: tags) {
       int kmer_size = it.first.length();
-      if (emap.find(kmer_size) != emap.end()) { // emap[kmer_size]
-        for (auto &e : emap[kmer_size]) {
-          bool found = false;
-          // Check if any tags associated with the current sequence are in the same location as the current expansion 
-          for (auto x : it.second) {
-            auto &tag = tags_vec[x.first];
-            if (overlapRegion(e.file, e.start_pos_2 == -1 ? 0 : e.start_pos_2, e.start_pos_2 == -1 ? 0 : e.start_pos_2+e.kmer_size_2, tag.file, tag.pos_start, tag.pos_end)) {
-              found = true;
-              break;
+      auto e = expansions.find(kmer_size);
+      if (e == expansions.end()) {
+        continue;
+      }
+      auto u = unbound_expansions.find(kmer_size);
+      for (const auto& x : e->second) {
+        // Check if any tags associated with the current sequence overlap a position where the expansion from x.first occurs
+        bool found = false;
+        for (auto t = it.second.begin(); t != it.second.end() && !found; t++) {
+          auto &tag = tags_vec[t->first];
+          for (int f = std::max((int)tag.file, 0); f < (int)x.second.size() && (f == tag.file || tag.file == -1) && !found; f++) {
+            const auto& positions = x.second[f];
+            auto p = std::lower_bound(positions.begin(), positions.end(), tag.pos_start-kmer_size+1);
+            found = p != positions.end() && (tag.pos_end == 0 || *p < tag.pos_end);
+            if (!found && u != unbound_expansions.end() && u->second.count(x.first) && u->second.at(x.first)[f] != -1) {
+              found = tag.pos_end == 0 || tag.pos_end > u->second.at(x.first)[f]+1;
             }
           }
-          if (!found) {
-            continue;
-          }
+        }
+        if (found) {
           // Decompose kmer of kmer_size by substring'ing
-          int decomposed_kmer_size = e.kmer_size;
-          std::string s = it.first.s_;
-          decomposed_kmers.insert(std::make_pair(s.substr(0, decomposed_kmer_size), kmer_size)); // to be added to tags map
+          decomposed_from.insert(std::make_pair(it.first.s_, x.first)); // to be added to tags map
+        }
+      }
+    }
+    // A prefix shared by sequences of different lengths expands to the smallest one, so each longer sequence must
+    // also be decomposed at that size (otherwise the chain of expansions stops at a prefix that isn't in the map)
+    std::map<std::string,int> decomposed_kmers; // Prefix -> k-mer size it's expanded to
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (const auto& d : decomposed_from) {
+        int kmer_size = d.first.length();
+        auto r = decomposed_kmers.insert(std::make_pair(d.first.substr(0, d.second), kmer_size));
+        if (r.second || kmer_size < r.first->second) {
+          r.first->second = std::min(r.first->second, kmer_size);
+          changed = true;
+        }
+        if (r.first->second < kmer_size && decomposed_from.insert(std::make_pair(d.first, r.first->second)).second) {
+          changed = true;
         }
       }
     }
@@ -722,6 +942,109 @@ struct SplitCode {
         tags[sstr].push_back(std::make_pair(k_expanded,-1)); // Put expansion at beginning of vector
       }
     }
+    plan_size = 0;
+    for (const auto& locs : kmer_size_locations) {
+      plan_size += locs.size();
+    }
+    plan_compile_time = std::chrono::duration<double>(std::chrono::steady_clock::now()-plan_start).count();
+    // Unanchored k-mers are probed at every read position; for those files, find all keys in one pass with an automaton instead
+    automaton_files.assign(kmer_size_locations.size(), false);
+    bool use_automaton = false;
+    for (int i = 0; i < (int)kmer_size_locations.size(); i++) {
+      for (const auto& loc : kmer_size_locations[i]) {
+        if (loc.second == -1) {
+          automaton_files[i] = true;
+          use_automaton = true;
+          break;
+        }
+      }
+    }
+    // (A small set of tags with few mismatches is searched for bit-parallel instead)
+    if (!use_automaton || (!shift_and_matcher.build(tags, tags_vec) && !tag_automaton.build(tags))) {
+      automaton_files.assign(kmer_size_locations.size(), false);
+    }
+    dynamic_files.assign(kmer_size_locations.size(), false);
+    for (const auto& probes : dynamic_probes) {
+      for (const auto& p : probes) {
+        int f = tags_vec[dynamicTagId(p)].file;
+        if (f >= 0 && f < (int)dynamic_files.size()) {
+          dynamic_files[f] = true;
+        }
+      }
+    }
+    tag_filters.assign(tags_vec.begin(), tags_vec.end());
+    // K-mers searched at fixed positions are looked up by their 2-bit code instead of being hashed as strings
+    buildKmerIndices();
+    compiled_locations.clear();
+    compiled_locations_storage.clear();
+    for (int i = 0; i < (int)kmer_size_locations.size(); i++) {
+      compiled_locations.emplace_back(new std::atomic<const CompiledPlan*>[MAX_COMPILED_RLEN+1]);
+      for (int rlen = 0; rlen <= MAX_COMPILED_RLEN; rlen++) {
+        compiled_locations[i][rlen] = nullptr;
+      }
+    }
+    // Longest sequence each tag name and group can match (to skip k-mer sizes that can't find the tag searched for after another)
+    name_max_k.assign(names.size(), 0);
+    group_max_k.assign(group_names.size(), 0);
+    auto update_max_k = [&](uint32_t tag_id, int len) {
+      auto& tag = tags_vec[tag_id];
+      name_max_k[tag.name_id] = std::max(name_max_k[tag.name_id], len);
+      if (tag.group < group_max_k.size()) {
+        group_max_k[tag.group] = std::max(group_max_k[tag.group], len);
+      }
+    };
+    for (const auto& it : tags) {
+      for (const auto& x : it.second) {
+        if (x.second != -1) {
+          update_max_k(x.first, it.first.length());
+        }
+      }
+    }
+    for (const auto& a : align_tags) {
+      update_max_k(a.tag_id, a.m+a.max_error);
+    }
+    for (const auto& p : polymer_tags) {
+      update_max_k(p.tag_id, p.range_end); // (The longer polymer lengths are tags with the same name and group)
+    }
+    for (const auto& w : whitelists) {
+      for (auto tag_id : w.tag_ids) {
+        update_max_k(tag_id, w.m);
+      }
+    }
+    for (const auto& p : partial_tags) {
+      update_max_k(p.tag_id, tags_vec[p.tag_id].seq.length());
+    }
+    // Results can be cached when they only depend on the read lengths and a fixed stretch at the start of each read
+    // (every k-mer is searched at a fixed location and nothing else looks at the rest of the read)
+    results_cacheable = !do_extract && !random_replacement && !quality_trimming_5 && !quality_trimming_3 && learn_n == 0;
+    cache_region.assign(kmer_size_locations.size(), 0);
+    if (results_cacheable) {
+      int max_match_len = 0; // Longest sequence that can be matched starting at a searched position
+      for (const auto& it : tags) {
+        max_match_len = std::max(max_match_len, (int)it.first.length());
+      }
+      for (const auto& a : align_tags) {
+        max_match_len = std::max(max_match_len, a.m+a.max_error);
+      }
+      for (const auto& p : polymer_tags) {
+        max_match_len = std::max(max_match_len, p.range_end);
+      }
+      for (const auto& w : whitelists) {
+        max_match_len = std::max(max_match_len, w.m);
+      }
+      for (const auto& p : partial_tags) {
+        max_match_len = std::max(max_match_len, (int)tags_vec[p.tag_id].seq.length());
+      }
+      for (int i = 0; i < (int)kmer_size_locations.size() && results_cacheable; i++) {
+        for (const auto& loc : kmer_size_locations[i]) {
+          if (loc.second == -1) {
+            results_cacheable = false;
+            break;
+          }
+          cache_region[i] = std::max(cache_region[i], trim_5_3_vec[i].first+loc.second+max_match_len);
+        }
+      }
+    }
     // DEBUG: Print out final locations
     /*for (int i = 0; i < kmer_size_locations.size(); i++) {
       for (int j = 0; j < kmer_size_locations[i].size(); j++) {
@@ -791,6 +1114,26 @@ struct SplitCode {
     std::string substitution;
   };
 
+  struct TagFilter { // Fields of a SplitCodeTag that getTag checks for every candidate, packed densely (tag_filters[i] mirrors tags_vec[i])
+    enum : uint8_t {initiator = 1, has_before = 2, has_before_group = 4, partial5 = 8, partial3 = 16};
+    uint32_t name_id;
+    uint32_t group;
+    uint32_t id_before;
+    int32_t pos_start;
+    int32_t pos_end;
+    int16_t file;
+    uint16_t extra_before;
+    uint16_t extra_before2;
+    uint8_t flags;
+
+    TagFilter(const SplitCodeTag& tag) : name_id(tag.name_id), group(tag.group), id_before(tag.id_before),
+                                         pos_start(tag.pos_start), pos_end(tag.pos_end), file(tag.file),
+                                         extra_before(tag.extra_before), extra_before2(tag.extra_before2) {
+      flags = (tag.initiator ? initiator : 0) | (tag.has_before ? has_before : 0) | (tag.has_before_group ? has_before_group : 0)
+            | (tag.partial5 ? partial5 : 0) | (tag.partial3 ? partial3 : 0);
+    }
+  };
+
   struct Results {
     std::vector<uint32_t> name_ids;
     std::vector<std::string> umi_data;
@@ -803,30 +1146,775 @@ struct SplitCode {
     std::vector<int32_t> n_bases_qual_trimmed_3;
     std::vector<std::pair<std::pair<uint32_t,int32_t>,std::pair<int32_t,int32_t>>> tag_trimmed_left; // tag name id, bases trimmed, match length, error
     std::vector<std::pair<std::pair<uint32_t,int32_t>,std::pair<int32_t,int32_t>>> tag_trimmed_right;
-    int id;
+    int64_t id;
     bool discard;
     bool passes_filter;
     std::string ofile;
     std::string identified_tags_seqs;
+    int learned_miss; // File in which nothing was found where tags were found while learning (so the read needs a full search); -1 if none
+  };
+  
+  struct ResultCache { // Least-recently-used cache of processRead() results (one per thread) keyed by the read bytes that the search can look at
+    explicit ResultCache(size_t capacity = 0) : capacity(capacity), n_hits(0), n_lookups(0) { }
+    const Results* find(const std::string& key) {
+      n_lookups++;
+      auto it = index.find(key);
+      if (it == index.end()) {
+        return nullptr;
+      }
+      entries.splice(entries.begin(), entries, it->second); // Now the most recently used
+      n_hits++;
+      return &it->second->second;
+    }
+    void insert(const std::string& key, const Results& results) {
+      if (capacity == 0) {
+        return;
+      }
+      if (index.size() >= capacity) {
+        index.erase(entries.back().first);
+        entries.pop_back();
+      }
+      entries.emplace_front(key, results);
+      index[key] = entries.begin();
+    }
+    size_t capacity;
+    size_t n_hits;
+    size_t n_lookups;
+    std::list<std::pair<std::string,Results>> entries; // Most recently used first
+    std::unordered_map<std::string,std::list<std::pair<std::string,Results>>::iterator> index;
+  };
+  
+  struct PrefixTrie { // Every prefix of the name (or group) ID sequences in a keep list; node 0 is the empty prefix
+    PrefixTrie() : children(1) { }
+    void insert(const std::vector<uint32_t>& u) {
+      int node = 0;
+      for (auto x : u) {
+        auto it = children[node].find(x);
+        if (it == children[node].end()) {
+          children[node][x] = children.size();
+          node = children.size();
+          children.emplace_back();
+        } else {
+          node = it->second;
+        }
+      }
+    }
+    int next(int node, uint32_t x) const { // -1 if no sequence continues that way
+      auto it = children[node].find(x);
+      return it == children[node].end() ? -1 : it->second;
+    }
+    std::vector<robin_hood::unordered_flat_map<uint32_t,int>> children;
+  };
+  
+  struct SeqString {
+    const char* p_;
+    unsigned short l_;
+    std::string s_;
+    SeqString(const char* p, unsigned short l) : p_(p), l_(l) { }
+    SeqString(const std::string& s) : p_(nullptr), l_(s.length()), s_(s) { }
+    SeqString() : p_{nullptr}, s_(""), l_(0) { }
+    bool operator==(const SeqString& ss) const {
+      return p_ ? 
+      (ss.p_ ? ss.l_ == l_ && std::strncmp(p_, ss.p_, l_) == 0 : ss.l_ == l_ && strncmp(p_, ss.s_.c_str(), l_) == 0) : 
+      (ss.p_ ? ss.l_ == l_ && strncmp(ss.p_, s_.c_str(), l_) == 0 : s_ == ss.s_);
+    }
+    size_t length() const {
+      return l_;
+    }
+  };
+
+  struct TagHits { // All keys of the tags map found in a read, bucketed by start position
+    struct Hit {
+      int32_t next; // Next hit starting at the same position (-1 if none)
+      int32_t k;
+      const std::vector<tval>* v;
+    };
+    std::vector<int32_t> heads; // heads[pos] = index into hits of the first hit starting at pos (-1 if none)
+    std::vector<Hit> hits;
+    void reset(int rlen) {
+      heads.assign(rlen, -1);
+      hits.clear();
+    }
+    void add(int pos, int k, const std::vector<tval>* v) {
+      hits.push_back({heads[pos], k, v});
+      heads[pos] = hits.size()-1;
+    }
+    const std::vector<tval>* find(int pos, int k) const {
+      for (int32_t h = heads[pos]; h != -1; h = hits[h].next) {
+        if (hits[h].k == k) {
+          return hits[h].v;
+        }
+      }
+      return nullptr;
+    }
+  };
+
+  struct TagAutomaton { // Aho-Corasick automaton over every key in the tags map (tags, neighbors, and expansion prefixes)
+    static const int ALPHABET = 5; // A, C, G, T, N
+    static const size_t MAX_NODES = 1 << 20;
+    std::vector<int32_t> next; // Complete transition table (ALPHABET entries per node)
+    std::vector<int32_t> dict; // Nearest proper suffix node that ends a key (-1 if none)
+    std::vector<int32_t> depth;
+    std::vector<const std::vector<tval>*> out; // Map entry of the key ending at a node (nullptr if no key ends there)
+
+    static int baseIndex(char c) {
+      switch(c) {
+      case 'A': return 0;
+      case 'C': return 1;
+      case 'G': return 2;
+      case 'T': return 3;
+      default: return 4;
+      }
+    }
+
+    bool empty() const {
+      return next.empty();
+    }
+
+    void clear() {
+      next.clear();
+      dict.clear();
+      depth.clear();
+      out.clear();
+    }
+
+    template <class Map>
+    bool build(const Map& m) { // Returns false (and leaves the automaton empty) if it would be too large
+      clear();
+      size_t total_len = 0;
+      for (const auto& it : m) {
+        total_len += it.first.length();
+      }
+      size_t max_nodes = std::min(total_len+1, MAX_NODES);
+      next.reserve(max_nodes*ALPHABET);
+      next.assign(ALPHABET, -1);
+      depth.assign(1, 0);
+      out.assign(1, nullptr);
+      for (const auto& it : m) {
+        const char* s = it.first.p_ ? it.first.p_ : it.first.s_.c_str();
+        int32_t node = 0;
+        for (size_t i = 0; i < it.first.length(); i++) {
+          int32_t& child = next[node*ALPHABET+baseIndex(s[i])];
+          if (child == -1) {
+            if (depth.size() >= MAX_NODES) {
+              clear();
+              return false;
+            }
+            child = depth.size();
+            next.resize(next.size()+ALPHABET, -1);
+            depth.push_back(depth[node]+1);
+            out.push_back(nullptr);
+          }
+          node = next[node*ALPHABET+baseIndex(s[i])]; // Reference may be invalidated by resize
+        }
+        out[node] = &it.second;
+      }
+      // Breadth-first pass: fill in failure transitions and dictionary links
+      std::vector<int32_t> fail(depth.size(), 0);
+      dict.assign(depth.size(), -1);
+      std::vector<int32_t> queue;
+      queue.reserve(depth.size());
+      for (int c = 0; c < ALPHABET; c++) {
+        int32_t& child = next[c];
+        if (child == -1) {
+          child = 0;
+        } else {
+          queue.push_back(child);
+        }
+      }
+      for (size_t qi = 0; qi < queue.size(); qi++) {
+        int32_t node = queue[qi];
+        dict[node] = out[fail[node]] ? fail[node] : dict[fail[node]];
+        for (int c = 0; c < ALPHABET; c++) {
+          int32_t& child = next[node*ALPHABET+c];
+          int32_t f = next[fail[node]*ALPHABET+c];
+          if (child == -1) {
+            child = f;
+          } else {
+            fail[child] = f;
+            queue.push_back(child);
+          }
+        }
+      }
+      return true;
+    }
+
+    void scan(const std::string& seq, TagHits& hits) const { // One pass over seq reporting every key occurrence
+      hits.reset(seq.length());
+      int32_t node = 0;
+      for (int i = 0; i < seq.length(); i++) {
+        node = next[node*ALPHABET+baseIndex(seq[i])];
+        for (int32_t o = out[node] ? node : dict[node]; o != -1; o = dict[o]) {
+          hits.add(i-depth[o]+1, depth[o], out[o]);
+        }
+      }
+    }
+  };
+
+  struct ShiftAndMatcher { // Bit-parallel (shift-and) search for a few short tags with few mismatches; reports the same keys as TagAutomaton
+    static const int MAX_PATTERNS = 64;
+    static const int MAX_WORDS = 2; // (Past this, the automaton is faster)
+    static const int MAX_ERROR = 2;
+    struct Word { // Patterns packed end to end into the bits of one 64-bit word
+      uint64_t masks[TagAutomaton::ALPHABET]; // Pattern positions matching each base (none match N)
+      uint64_t starts; // First position of each pattern
+      uint64_t ends; // Last position of each pattern
+      uint8_t lens[64]; // Length of the pattern ending at each bit
+    };
+    ShiftAndMatcher() : max_error(0) { }
+    std::vector<Word> words;
+    std::vector<int> key_lengths; // Distinct lengths of the keys in the tags map (ascending)
+    int max_error;
+
+    bool empty() const {
+      return words.empty();
+    }
+
+    void clear() {
+      words.clear();
+      key_lengths.clear();
+      max_error = 0;
+    }
+
+    template <class Map>
+    bool build(const Map& m, const std::vector<SplitCodeTag>& tags_vec) {
+      // Every key (other than expansion prefixes) must be a tag's sequence with mismatches, so an occurrence of some tag within
+      // max_error mismatches covers it; returns false (and leaves the matcher empty) otherwise or if there are too many tags
+      clear();
+      std::set<std::string> patterns;
+      std::set<int> lens;
+      for (const auto& it : m) {
+        const char* s = it.first.p_ ? it.first.p_ : it.first.s_.c_str();
+        int k = it.first.length();
+        lens.insert(k);
+        for (const auto& x : it.second) {
+          if (x.second == -1) {
+            continue;
+          }
+          const std::string& seq = tags_vec[x.first].seq;
+          if ((int)seq.length() != k || k > 64) {
+            clear();
+            return false;
+          }
+          int mismatches = 0;
+          for (int i = 0; i < k; i++) {
+            if (TagAutomaton::baseIndex(seq[i]) == 4) {
+              clear();
+              return false;
+            }
+            mismatches += (s[i] != seq[i]);
+          }
+          max_error = std::max(max_error, mismatches);
+          patterns.insert(seq);
+        }
+      }
+      if (patterns.empty() || patterns.size() > MAX_PATTERNS || max_error > MAX_ERROR) {
+        clear();
+        return false;
+      }
+      int bit = 64;
+      for (const auto& seq : patterns) {
+        if (bit+seq.length() > 64) {
+          if (words.size() == MAX_WORDS) {
+            clear();
+            return false;
+          }
+          words.emplace_back();
+          Word& w = words.back();
+          std::fill(w.masks, w.masks+TagAutomaton::ALPHABET, 0);
+          std::fill(w.lens, w.lens+64, 0);
+          w.starts = w.ends = 0;
+          bit = 0;
+        }
+        Word& w = words.back();
+        w.starts |= 1ULL << bit;
+        for (int i = 0; i < seq.length(); i++) {
+          w.masks[TagAutomaton::baseIndex(seq[i])] |= 1ULL << (bit+i);
+        }
+        bit += seq.length();
+        w.ends |= 1ULL << (bit-1);
+        w.lens[bit-1] = seq.length();
+      }
+      key_lengths.assign(lens.begin(), lens.end());
+      return true;
+    }
+
+    template <class Map>
+    void scan(const std::string& seq, const Map& m, TagHits& hits) const { // One pass over seq per word; each occurrence is checked against the map
+      hits.reset(seq.length());
+      for (const auto& w : words) {
+        switch (max_error) {
+        case 0: scanWord<0>(w, seq, m, hits); break;
+        case 1: scanWord<1>(w, seq, m, hits); break;
+        default: scanWord<2>(w, seq, m, hits); break;
+        }
+      }
+    }
+
+    template <int E, class Map>
+    void scanWord(const Word& w, const std::string& seq, const Map& m, TagHits& hits) const {
+      uint64_t r[E+1] = {}; // r[e]: pattern prefixes ending at the current base with at most e mismatches
+      for (int i = 0; i < seq.length(); i++) {
+        uint64_t mask = w.masks[TagAutomaton::baseIndex(seq[i])];
+        uint64_t prev = r[0]; // (Value before this base)
+        r[0] = ((r[0] << 1) | w.starts) & mask;
+        for (int e = 1; e <= E; e++) {
+          uint64_t curr = r[e];
+          r[e] = (((curr << 1) | w.starts) & mask) | (prev << 1) | w.starts;
+          prev = curr;
+        }
+        uint64_t matches = r[E] & w.ends;
+        while (matches != 0) {
+          int len = w.lens[__builtin_ctzll(matches)];
+          matches &= matches-1;
+          int pos = i-len+1;
+          for (int k : key_lengths) { // The key itself and any prefixes leading to it
+            if (k > len) {
+              break;
+            }
+            if (hits.find(pos, k) != nullptr) {
+              continue;
+            }
+            auto it = m.find(SeqString(seq.c_str()+pos, k));
+            if (it != m.end()) {
+              hits.add(pos, k, &it->second);
+            }
+          }
+        }
+      }
+    }
+  };
+
+  struct KmerTable { // Lookup of the keys (of one length k) in the tags map by their 2-bit code; only ACGT keys are stored
+    static const int DIRECT_MAX_K = 10; // Up to this k, the table is a direct array indexed by the code
+    struct Entry {
+      const std::vector<tval>* v; // The key's tags map entry
+      uint32_t tag_id; // If resolved, the only candidate getTag needs to check (the first tag in v with the smallest error)
+      int16_t error;
+      int16_t expansion; // Last expansion in v (-1 if none)
+      bool resolved; // v's tags share a name, group and initiator status, and have no before/partial constraints or location checks left in this table
+      bool exact; // The key is a tag's own sequence (or a prefix of one that an expansion goes through)
+    };
+    static const size_t TIER_MIN_BYTES = 1 << 18; // Below this, the whole table stays in cache anyway
+    KmerTable() : k(0), mask(0), shift(64), exact_mask(0), exact_shift(64) { }
+    int k;
+    std::vector<Entry> entries; // (With tiers, exact entries come first)
+    std::vector<uint32_t> direct; // Code -> 1 + index into entries (0 if absent)
+    std::vector<std::pair<uint64_t,uint32_t>> slots; // Larger k: open addressing with linear probing
+    uint64_t mask;
+    int shift; // 64 - log2(slots.size())
+    std::vector<std::pair<uint64_t,uint32_t>> exact_slots; // First tier (if used): only the exact keys, which then stay out of direct/slots
+    uint64_t exact_mask;
+    int exact_shift;
+
+    static bool encode(const char* s, int k, uint64_t& code) { // Returns false if s[0..k) contains a non-ACGT base
+      code = 0;
+      for (int i = 0; i < k; i++) {
+        int c = TagAutomaton::baseIndex(s[i]);
+        if (c > 3) {
+          return false;
+        }
+        code = (code << 2) | c;
+      }
+      return true;
+    }
+
+    static uint64_t slot(uint64_t code, int shift) { // Fibonacci hashing: the top bits of the product are the well-mixed ones
+      return (code * 0x9E3779B97F4A7C15ULL) >> shift;
+    }
+
+    static void fillSlots(std::vector<std::pair<uint64_t,uint32_t>>& slots, uint64_t& mask, int& shift, const std::vector<std::pair<uint64_t,Entry>>& keys,
+                          uint32_t begin, uint32_t end) { // Open addressing table of keys[begin..end)
+      size_t capacity = 16;
+      shift = 60;
+      while (capacity < 2*(end-begin)) {
+        capacity <<= 1;
+        shift--;
+      }
+      mask = capacity-1;
+      slots.assign(capacity, std::make_pair(0, 0));
+      for (uint32_t j = begin; j < end; j++) {
+        uint64_t i = slot(keys[j].first, shift);
+        while (slots[i].second != 0) {
+          i = (i+1) & mask;
+        }
+        slots[i] = std::make_pair(keys[j].first, j+1);
+      }
+    }
+
+    void build(int k, std::vector<std::pair<uint64_t,Entry>> keys, bool tiers = false) {
+      // tiers: when most keys are neighbors and the table is too big to stay in cache, reads matching a tag exactly only go through a
+      // small first tier (every key is in exactly one tier, so its entry is complete either way; misses probe both tiers, so this is
+      // only worth it where lookups mostly hit)
+      this->k = k;
+      auto n_exact = std::count_if(keys.begin(), keys.end(), [](const std::pair<uint64_t,Entry>& key) { return key.second.exact; });
+      size_t bytes = k <= DIRECT_MAX_K ? ((size_t)1 << (2*k))*sizeof(uint32_t) : 2*keys.size()*sizeof(slots[0]);
+      uint32_t begin = 0;
+      exact_slots.clear();
+      if (tiers && bytes >= TIER_MIN_BYTES && 4*(size_t)n_exact <= keys.size()) {
+        std::stable_partition(keys.begin(), keys.end(), [](const std::pair<uint64_t,Entry>& key) { return key.second.exact; });
+        begin = n_exact;
+        fillSlots(exact_slots, exact_mask, exact_shift, keys, 0, begin);
+      }
+      entries.clear();
+      entries.reserve(keys.size());
+      for (const auto& key : keys) {
+        entries.push_back(key.second);
+      }
+      if (k <= DIRECT_MAX_K && !keys.empty()) {
+        direct.assign((size_t)1 << (2*k), 0);
+        for (uint32_t j = begin; j < keys.size(); j++) {
+          direct[keys[j].first] = j+1;
+        }
+        return;
+      }
+      fillSlots(slots, mask, shift, keys, begin, keys.size());
+    }
+
+    const void* slotAddress(uint64_t code) const { // Where the lookup of code starts (for prefetching)
+      if (!exact_slots.empty()) {
+        return &exact_slots[slot(code, exact_shift)];
+      }
+      return !direct.empty() ? (const void*)&direct[code] : (const void*)&slots[slot(code, shift)];
+    }
+
+    const Entry* find(uint64_t code) const {
+      if (!exact_slots.empty()) {
+        for (uint64_t i = slot(code, exact_shift); exact_slots[i].second != 0; i = (i+1) & exact_mask) {
+          if (exact_slots[i].first == code) {
+            return &entries[exact_slots[i].second-1];
+          }
+        }
+      }
+      if (!direct.empty()) {
+        return direct[code] == 0 ? nullptr : &entries[direct[code]-1];
+      }
+      for (uint64_t i = slot(code, shift); slots[i].second != 0; i = (i+1) & mask) {
+        if (slots[i].first == code) {
+          return &entries[slots[i].second-1];
+        }
+      }
+      return nullptr;
+    }
+  };
+
+  struct KmerIndex { // K-mer tables of one file and k, one for each range of positions in which the same tags can be found
+    static const int MAX_RANGES = 8; // (More ranges, or ranges duplicating too many entries, are merged into one table)
+    std::vector<int> starts; // tables[i] covers positions starts[i] up to starts[i+1]
+    std::vector<KmerTable> tables;
+
+    const KmerTable& table(int pos) const {
+      int i = starts.size()-1;
+      while (starts[i] > pos) { // (starts[0] is 0)
+        i--;
+      }
+      return tables[i];
+    }
+  };
+
+  struct DynamicHit { // A tag matched at probe time
+    int k;
+    uint32_t tag_id;
+    int error;
+  };
+
+  struct UMIAnchors { // Where tags that open a UMI (closed by a later tag or location) ended in the current read file
+    // Lookups see the anchors as of the last snapshot(); anchors opened or closed since then only show up after the next one
+    struct Anchor {
+      int16_t id; // UMI id
+      int32_t pos;
+      int opened;
+      int closed;
+    };
+    UMIAnchors() : view(0) { }
+    std::vector<Anchor> anchors;
+    int view; // Epoch of the last snapshot
+    void clear() {
+      anchors.clear();
+      view = 0;
+    }
+    void snapshot() {
+      view++;
+    }
+    void open(int16_t id, int32_t pos) {
+      anchors.push_back({id, pos, view+1, std::numeric_limits<int>::max()});
+    }
+    void close(int16_t id, int32_t pos) { // Closes the earliest open anchor of id at pos
+      for (auto& a : anchors) {
+        if (a.id == id && a.pos == pos && a.closed == std::numeric_limits<int>::max()) {
+          a.closed = view+1;
+          return;
+        }
+      }
+    }
+    bool visible(size_t i, int16_t id) const {
+      return anchors[i].id == id && anchors[i].opened <= view && anchors[i].closed > view;
+    }
+  };
+
+  struct Matcher { // Scratch space reused by every read that one thread searches (one per thread, like ResultCache)
+    struct AlignHit {
+      int32_t pos;
+      int32_t k;
+      uint32_t align_i; // Index into align_tags
+      int error;
+    };
+    std::string seq;
+    TagHits tag_hits;
+    std::vector<DynamicHit> dynamic_hits;
+    std::vector<AlignHit> align_hits; // Matches of the align tags in the current read file (from alignRead()), by position
+    std::vector<int32_t> align_start; // The matches at pos are align_hits[align_start[pos]] up to align_hits[align_start[pos+1]]
+    std::vector<int> align_ends;
+    std::vector<uint32_t> group_v;
+    std::vector<int> caps_left;
+    std::vector<uint32_t> radix_n_digits; // [radix group] = digits filled so far (for radix_ids)
+    UMIAnchors umi_anchors;
+    // Finds in the current read of the tags and groups that have minFinds/maxFinds limits; only the entries
+    // listed in tags_found and groups_found can be nonzero (so resetting costs as much as the finds did)
+    std::vector<int> tag_finds;
+    std::vector<int> group_finds; // Every find (for minFindsG)
+    std::vector<int> group_kept; // Finds that didn't exceed their tag's maxFinds (for maxFindsG)
+    std::vector<uint32_t> tags_found;
+    std::vector<uint32_t> groups_found;
+    void resetFinds(size_t n_tags, size_t n_groups) {
+      if (tag_finds.size() != n_tags || group_finds.size() != n_groups) {
+        tag_finds.assign(n_tags, 0);
+        group_finds.assign(n_groups, 0);
+        group_kept.assign(n_groups, 0);
+        tags_found.clear();
+        groups_found.clear();
+        return;
+      }
+      for (auto t : tags_found) {
+        tag_finds[t] = 0;
+      }
+      for (auto g : groups_found) {
+        group_finds[g] = 0;
+        group_kept[g] = 0;
+      }
+      tags_found.clear();
+      groups_found.clear();
+    }
+  };
+
+  struct PartialTag { // Tag that may be truncated at its 5′ end (at the start of the read) or 3′ end (at the end of the read)
+    uint32_t tag_id;
+    int min_match;
+    double mismatch_freq;
+  };
+
+  struct PolymerTag { // Homopolymer tag (e.g. A:5-20) matched by scanning the run rather than one tags map entry per length
+    uint32_t tag_id; // Tag of length range_begin; the tag of length range_begin+i is tag_id+i
+    char base;
+    int range_begin;
+    int range_end;
+    int max_error;
+  };
+
+  struct AlignTag { // Tag matched by bit-parallel (Myers) edit distance rather than by enumerating its neighbors
+    static const int MAX_LEN = 1024;
+    uint32_t tag_id;
+    int m; // Tag length
+    int max_error;
+    int probe_k; // Shortest read substring that can be within max_error of the tag
+    int n_blocks;
+    std::vector<uint64_t> peq; // Pattern match bit-vectors: n_blocks 64-bit words for each of A, C, G, T
+    std::vector<uint64_t> peq_rev; // The same for the reversed tag
+
+    AlignTag(uint32_t tag_id, const std::string& seq, int max_error) : tag_id(tag_id), m(seq.length()), max_error(max_error) {
+      probe_k = std::max(m-max_error, 1);
+      n_blocks = (m+63)/64;
+      peq.assign(4*n_blocks, 0);
+      peq_rev.assign(4*n_blocks, 0);
+      for (int i = 0; i < m; i++) {
+        int c = TagAutomaton::baseIndex(seq[i]);
+        if (c < 4) {
+          peq[c*n_blocks+i/64] |= (uint64_t)1 << (i%64);
+          peq_rev[c*n_blocks+(m-1-i)/64] |= (uint64_t)1 << ((m-1-i)%64);
+        }
+      }
+    }
+
+    // Computes the edit distance between the tag and s[0..j) for j = 1..len (stored in dist[j-1]);
+    // returns the last j computed (stops early once no longer prefix can be within max_error)
+    // reverse: aligns the reversed tag against s[-1], s[-2], ... instead (dist[j-1] is for the j bases before s)
+    int align(const char* s, int len, int* dist, bool reverse = false) const {
+      uint64_t pv[MAX_LEN/64];
+      uint64_t mv[MAX_LEN/64];
+      std::fill(pv, pv+n_blocks, ~(uint64_t)0); // Column 0: D[i][0] = i
+      std::fill(mv, mv+n_blocks, 0);
+      const auto& eqs = reverse ? peq_rev : peq;
+      int score = m;
+      for (int j = 0; j < len; j++) {
+        score += advance(pv, mv, eqs, reverse ? s[-1-j] : s[j], 1); // Row 0: D[0][j] = j (the match is anchored at s[0])
+        dist[j] = score;
+        if (score-(len-j-1) > max_error) {
+          return j+1;
+        }
+      }
+      return len;
+    }
+
+    // Adds the end (exclusive) of every substring of s[0..len) within max_error of the tag to ends, in ascending order
+    void ends(const char* s, int len, std::vector<int>& ends) const {
+      uint64_t pv[MAX_LEN/64];
+      uint64_t mv[MAX_LEN/64];
+      std::fill(pv, pv+n_blocks, ~(uint64_t)0);
+      std::fill(mv, mv+n_blocks, 0);
+      int score = m;
+      for (int j = 0; j < len; j++) {
+        score += advance(pv, mv, peq, s[j], 0); // Row 0: D[0][j] = 0 (the match can start anywhere)
+        if (score <= max_error) {
+          ends.push_back(j+1);
+        }
+      }
+    }
+
+    // Adds one read base (a column of the DP matrix) to the vertical deltas pv/mv; hin is the horizontal delta in row 0
+    // Returns the horizontal delta in the last row (the change in the distance to the whole tag)
+    int advance(uint64_t* pv, uint64_t* mv, const std::vector<uint64_t>& eqs, char base, int hin) const {
+      int c = TagAutomaton::baseIndex(base);
+      const uint64_t last_bit = (uint64_t)1 << ((m-1)%64);
+      for (int b = 0; b < n_blocks; b++) {
+        uint64_t eq = c < 4 ? eqs[c*n_blocks+b] : 0;
+        uint64_t xv = eq | mv[b];
+        if (hin < 0) {
+          eq |= 1;
+        }
+        uint64_t xh = (((eq & pv[b]) + pv[b]) ^ pv[b]) | eq;
+        uint64_t ph = mv[b] | ~(xh | pv[b]);
+        uint64_t mh = pv[b] & xh;
+        uint64_t high = b == n_blocks-1 ? last_bit : (uint64_t)1 << 63;
+        int hout = (ph & high) ? 1 : ((mh & high) ? -1 : 0);
+        ph <<= 1;
+        mh <<= 1;
+        if (hin < 0) {
+          mh |= 1;
+        } else if (hin > 0) {
+          ph |= 1;
+        }
+        pv[b] = mh | ~(xv | ph);
+        mv[b] = ph & xv;
+        hin = hout;
+      }
+      return hin;
+    }
   };
-  
-  struct SeqString {
-    const char* p_;
-    unsigned short l_;
-    std::string s_;
-    SeqString(const char* p, unsigned short l) : p_(p), l_(l) { }
-    SeqString(const std::string& s) : p_(nullptr), l_(s.length()), s_(s) { }
-    SeqString() : p_{nullptr}, s_(""), l_(0) { }
-    bool operator==(const SeqString& ss) const {
-      return p_ ? 
-      (ss.p_ ? ss.l_ == l_ && std::strncmp(p_, ss.p_, l_) == 0 : ss.l_ == l_ && strncmp(p_, ss.s_.c_str(), l_) == 0) : 
-      (ss.p_ ? ss.l_ == l_ && strncmp(ss.p_, s_.c_str(), l_) == 0 : s_ == ss.s_);
+
+  struct WhitelistIndex { // Substitution-only tags of one length and location, corrected through two half-sequence indices rather than enumerated neighbors
+    // (a k-mer within d mismatches of a tag is within d/2 mismatches of it on one of the two halves)
+    static const int MAX_LEN = 32;
+    int m; // Tag length
+    int h; // Length of the left half
+    int16_t file;
+    int32_t pos_start;
+    int32_t pos_end;
+    int max_error; // Largest max_errors entry
+    std::vector<uint32_t> tag_ids;
+    std::vector<uint64_t> codes; // 2 bits per base (base i in bits 2i and 2i+1)
+    std::vector<int8_t> max_errors;
+    std::vector<uint32_t> members[2]; // Indices into tag_ids ordered by left/right half
+    robin_hood::unordered_flat_map<uint64_t, std::pair<uint32_t,uint32_t>> halves[2]; // Half sequence -> range in members
+
+    WhitelistIndex(int m, int16_t file, int32_t pos_start, int32_t pos_end) : m(m), h(m/2), file(file), pos_start(pos_start), pos_end(pos_end), max_error(0) {}
+
+    static void encode(const char* s, int len, uint64_t& code, uint64_t& n_mask) {
+      // n_mask has the low bit set for each non-ACGT base (encoded as A) so it always counts as a mismatch
+      code = 0;
+      n_mask = 0;
+      for (int i = 0; i < len; i++) {
+        int c = TagAutomaton::baseIndex(s[i]);
+        if (c < 4) {
+          code |= (uint64_t)c << (2*i);
+        } else {
+          n_mask |= (uint64_t)1 << (2*i);
+        }
+      }
     }
-    size_t length() const {
-      return l_;
+
+    static int distance(uint64_t x, uint64_t y, uint64_t n_mask) {
+      uint64_t d = x ^ y;
+      return __builtin_popcountll(((d | (d >> 1)) & 0x5555555555555555ULL) | n_mask);
+    }
+
+    uint64_t half(uint64_t code, int side) const {
+      return side == 0 ? code & leftMask() : code >> (2*h);
+    }
+
+    uint64_t leftMask() const {
+      return ((uint64_t)1 << (2*h)) - 1; // (h <= 16)
+    }
+
+    void add(uint32_t tag_id, const std::string& seq, int tag_max_error) {
+      uint64_t code, n_mask;
+      encode(seq.c_str(), m, code, n_mask);
+      tag_ids.push_back(tag_id);
+      codes.push_back(code);
+      max_errors.push_back(tag_max_error);
+      max_error = std::max(max_error, tag_max_error);
+    }
+
+    void build() {
+      for (int side = 0; side < 2; side++) {
+        auto& v = members[side];
+        v.resize(codes.size());
+        for (uint32_t i = 0; i < v.size(); i++) {
+          v[i] = i;
+        }
+        std::stable_sort(v.begin(), v.end(), [&](uint32_t a, uint32_t b) { return half(codes[a], side) < half(codes[b], side); });
+        halves[side].clear();
+        for (uint32_t i = 0; i < v.size();) {
+          uint32_t j = i;
+          uint64_t x = half(codes[v[i]], side);
+          while (j < v.size() && half(codes[v[j]], side) == x) {
+            j++;
+          }
+          halves[side][x] = std::make_pair(i, j);
+          i = j;
+        }
+      }
+    }
+
+    template <typename F>
+    void forEachVariant(uint64_t x, int len, int start, int subs, F& f) const {
+      // Calls f on x and on every sequence with up to subs substitutions of x (each once)
+      f(x);
+      for (int i = start; subs > 0 && i < len; i++) {
+        uint64_t b = (x >> (2*i)) & 3;
+        for (uint64_t c = 0; c < 4; c++) {
+          if (c != b) {
+            forEachVariant(x ^ ((b ^ c) << (2*i)), len, i+1, subs-1, f);
+          }
+        }
+      }
+    }
+
+    template <typename F>
+    void find(uint64_t code, uint64_t n_mask, F f) const {
+      // Calls f(member, distance) for every member within its max_error of code
+      int subs = max_error/2;
+      for (int side = 0; side < 2; side++) {
+        auto lookup = [&](uint64_t x) {
+          const auto& it = halves[side].find(x);
+          if (it == halves[side].end()) {
+            return;
+          }
+          for (uint32_t i = it->second.first; i < it->second.second; i++) {
+            uint32_t j = members[side][i];
+            if (side == 1 && distance(code & leftMask(), codes[j] & leftMask(), 0) <= subs) {
+              continue; // Already found through the left half
+            }
+            int d = distance(code, codes[j], n_mask);
+            if (d <= max_errors[j]) {
+              f(j, d);
+            }
+          }
+        };
+        forEachVariant(half(code, side), side == 0 ? h : m-h, 0, subs, lookup);
+      }
     }
   };
-  
+
   struct UMI {
     uint32_t id1, id2;
     uint16_t length_range_start;
@@ -946,33 +2034,16 @@ struct SplitCode {
     }
   }
   
-  void generate_partial_matches(std::string seq, int partial5_min_match, double partial5_mismatch_freq, int partial3_min_match, double partial3_mismatch_freq, uint32_t& new_tag_index, SplitCodeTag tag) {
-    bool use_N = !random_replacement;
+  void addPartialTags(const std::string& seq, int partial5_min_match, double partial5_mismatch_freq, int partial3_min_match, double partial3_mismatch_freq, uint32_t& new_tag_index, SplitCodeTag tag) {
+    // Partial tags are matched at the ends of reads when probed (see addPartialHits) rather than through the tags map
     if (partial5_min_match != 0 && tag.pos_start <= 0) {
       auto new_tag = tag;
       new_tag.pos_end = (tag.pos_end == 0 ? seq.length() : std::min((int)seq.length(), tag.pos_end)); // We re-adjust this so we only search where absolutely necessary
       new_tag.partial5 = true;
       ++new_tag_index;
       tags_vec.push_back(new_tag);
-      for (int i = 0; i < seq.length(); i++) {
-        std::string s = seq.substr(i);
-        size_t l = s.length();
-        // TODO: VERBOSE output
-        int mismatch_dist = floor(partial5_mismatch_freq*l);
-        std::cerr << "generate_partial_matches " << partial5_mismatch_freq << " " << l << " " << mismatch_dist << std::endl;
-        if (l >= partial5_min_match) {
-          addToMap(s, new_tag_index);
-          std::unordered_map<std::string,int> mismatches;
-          generate_hamming_mismatches(s, mismatch_dist, mismatches, use_N, mismatch_dist+i);
-          mismatches.erase(s); // Remove s in case it was generated
-          for (auto mm : mismatches) {
-            std::string mismatch_seq = mm.first;
-            int error = mm.second;
-            addToMap(mismatch_seq, new_tag_index, error);
-            // DEBUG:
-            std::cerr << s << ": " << mismatch_seq << " " << error << " | " << mm.second << " [partial5]" << new_tag_index << " " << init << std::endl;
-          }
-        }
+      if (partial5_min_match <= (int)seq.length()) {
+        partial_tags.push_back({new_tag_index, partial5_min_match, partial5_mismatch_freq});
       }
     }
     if (partial3_min_match != 0) {
@@ -980,23 +2051,8 @@ struct SplitCode {
       new_tag.partial3 = true;
       ++new_tag_index;
       tags_vec.push_back(new_tag);
-      for (int i = 0; i < seq.length(); i++) {
-        std::string s = seq.substr(0, i+1);
-        size_t l = s.length();
-        int mismatch_dist = floor(partial3_mismatch_freq*l);
-        if (l >= partial3_min_match) {
-          addToMap(s, new_tag_index);
-          std::unordered_map<std::string,int> mismatches;
-          generate_hamming_mismatches(s, mismatch_dist, mismatches, use_N, mismatch_dist+(seq.length()-(i+1)));
-          mismatches.erase(s); // Remove s in case it was generated
-          for (auto mm : mismatches) {
-            std::string mismatch_seq = mm.first;
-            int error = mm.second;
-            addToMap(mismatch_seq, new_tag_index, error);
-            // DEBUG:
-            // std::cout << s << ": " << mismatch_seq << " " << error << " | " << mm.second << " [partial3]" << std::endl;
-          }
-        }
+      if (partial3_min_match <= (int)seq.length()) {
+        partial_tags.push_back({new_tag_index, partial3_min_match, partial3_mismatch_freq});
       }
     }
   }
@@ -1019,7 +2075,8 @@ struct SplitCode {
               int16_t file, int32_t pos_start, int32_t pos_end,
               uint16_t max_finds, uint16_t min_finds, bool not_include_in_barcode,
               dir trim, int trim_offset, std::string after_str, std::string before_str,
-              int partial5_min_match, double partial5_mismatch_freq, int partial3_min_match, double partial3_mismatch_freq, std::string subs_str) {
+              int partial5_min_match, double partial5_mismatch_freq, int partial3_min_match, double partial3_mismatch_freq, std::string subs_str,
+              matcher match = match_neighbors) {
     if (init) {
       std::cerr << "Error: Already initialized" << std::endl;
       return false;
@@ -1043,6 +2100,7 @@ struct SplitCode {
       std::cerr << "Error: Sequence #" << n_tag_entries << ": \"" << name << "\" is empty" << std::endl;
       return false;
     }
+    int polymer_range_begin = 0;
     std::string polymer_str = seq.substr(seq.find(":") + 1);
     if (!polymer_str.empty() && seq.find(":") != std::string::npos) { // sequence:range_begin-range_end
       std::string s1 = polymer_str.substr(0, polymer_str.find("-"));
@@ -1063,6 +2121,9 @@ struct SplitCode {
         std::cerr << "Error: Sequence #" << n_tag_entries << ": \"" << name << "\" is not properly formatted" << std::endl;
         return false;
       }
+      if (original_seq.length() == 1 && match == match_neighbors && std::min(indel_dist, total_dist) == 0 && partial5_min_match == 0 && partial3_min_match == 0) {
+        polymer_range_begin = range_begin; // Homopolymer: lengths are still separate tags but are matched by addPolymerHits
+      }
       std::string new_seq = "";
       for (int i = range_begin; i <= range_end; i++) {
         std::string s = "";
@@ -1092,12 +2153,10 @@ struct SplitCode {
       }
     }
     uint32_t name_id;
-    const auto& itnames = std::find(names.begin(), names.end(), name);
-    if (itnames == names.end()) {
+    if (!getNameId(name, name_id)) {
       name_id = names.size();
       names.push_back(name);
-    } else {
-      name_id = itnames - names.begin();
+      names_map[name] = name_id;
     }
     for (int i = 0; i < group_name.size(); i++) {
       if (group_name[i] == '#' || group_name[i] == '|' || group_name[i] == '(' || group_name[i] == ')' || group_name[i] == '[' || group_name[i] == ']' || group_name[i] == '{' || group_name[i] == '}' || group_name[i] == '@') {
@@ -1106,14 +2165,10 @@ struct SplitCode {
       }
     }
     uint32_t group_name_id = -1;
-    if (!group_name.empty()) {
-      const auto& itgnames = std::find(group_names.begin(), group_names.end(), group_name);
-      if (itgnames == group_names.end()) {
-        group_name_id = group_names.size();
-        group_names.push_back(group_name);
-      } else {
-        group_name_id = itgnames - group_names.begin();
-      }
+    if (!group_name.empty() && !getGroupId(group_name, group_name_id)) {
+      group_name_id = group_names.size();
+      group_names.push_back(group_name);
+      group_names_map[group_name] = group_name_id;
     }
     
     std::transform(seq.begin(), seq.end(), seq.begin(), ::toupper);
@@ -1147,10 +2202,13 @@ struct SplitCode {
     for (file = start_file; file < end_file; file++) {
       new_tag.file = file;
       char delimeter = '/'; // Sequence can be delimited by '/' if the user gives multiple sequences for one tag record
-      std::stringstream ss(new_tag_seq);
       int num_seqs = 0;
       auto new_tag_index_original = new_tag_index;
-      while (std::getline(ss, seq, delimeter)) {
+      size_t seq_start = 0;
+      while (seq_start < new_tag_seq.length()) {
+        size_t seq_end = std::min(new_tag_seq.find(delimeter, seq_start), new_tag_seq.length());
+        seq = new_tag_seq.substr(seq_start, seq_end-seq_start);
+        seq_start = seq_end+1;
         if (seq.empty()) {
           continue;
         }
@@ -1169,17 +2227,44 @@ struct SplitCode {
           return false;
         }
         
-        std::unordered_map<std::string,int> mismatches;
-        generate_indels_hamming_mismatches(seq, mismatch_dist, indel_dist, total_dist, mismatches);
-        for (auto mm : mismatches) {
-          std::string mismatch_seq = mm.first;
-          int error = mm.second; // The number of substitutions, insertions, or deletions
-          addToMap(mismatch_seq, new_tag_index, error);
-          // DEBUG:
-          // std::cout << seq << ": " << mismatch_seq << " " << error << " | " << total_dist << " " << mm.second << std::endl;
-        }
-        addToMap(seq, new_tag_index);
-        generate_partial_matches(seq, partial5_min_match, partial5_mismatch_freq, partial3_min_match, partial3_mismatch_freq, new_tag_index, new_tag);
+        if (match == match_align) { // Errors are found by alignment (total_dist = edit distance budget) so the tag isn't put in the map
+          if ((int)seq.length() > AlignTag::MAX_LEN || total_dist >= (int)seq.length()) {
+            std::cerr << "Error: Sequence #" << n_tag_entries << ": \"" << name << "\" is too long or has too large of a distance to be aligned" << std::endl;
+            return false;
+          }
+          align_tags.push_back(AlignTag(new_tag_index, seq, total_dist));
+        } else if (match == match_whitelist) { // Mismatches are corrected through the whitelist index of tags of the same length and location
+          if (seq.length() > WhitelistIndex::MAX_LEN || std::min(indel_dist, total_dist) != 0) {
+            std::cerr << "Error: Sequence #" << n_tag_entries << ": \"" << name << "\" must be at most " << WhitelistIndex::MAX_LEN << " bp and have no indels for whitelist matching" << std::endl;
+            return false;
+          }
+          int w = whitelists.size()-1;
+          while (w >= 0 && !(whitelists[w].m == (int)seq.length() && whitelists[w].file == new_tag.file && whitelists[w].pos_start == new_tag.pos_start && whitelists[w].pos_end == new_tag.pos_end)) {
+            w--;
+          }
+          if (w < 0) {
+            w = whitelists.size();
+            whitelists.push_back(WhitelistIndex(seq.length(), new_tag.file, new_tag.pos_start, new_tag.pos_end));
+          }
+          whitelists[w].add(new_tag_index, seq, std::min(mismatch_dist, total_dist));
+        } else if (polymer_range_begin != 0) {
+          if ((int)seq.length() == polymer_range_begin) {
+            int range_end = polymer_range_begin + std::count(new_tag_seq.begin(), new_tag_seq.end(), delimeter);
+            polymer_tags.push_back({new_tag_index, seq[0], polymer_range_begin, range_end, std::min(mismatch_dist, total_dist)});
+          }
+        } else {
+          std::unordered_map<std::string,int> mismatches;
+          generate_indels_hamming_mismatches(seq, mismatch_dist, indel_dist, total_dist, mismatches);
+          for (auto mm : mismatches) {
+            std::string mismatch_seq = mm.first;
+            int error = mm.second; // The number of substitutions, insertions, or deletions
+            addToMap(mismatch_seq, new_tag_index, error);
+            // DEBUG:
+            // std::cout << seq << ": " << mismatch_seq << " " << error << " | " << total_dist << " " << mm.second << std::endl;
+          }
+          addToMap(seq, new_tag_index);
+        }
+        addPartialTags(seq, partial5_min_match, partial5_mismatch_freq, partial3_min_match, partial3_mismatch_freq, new_tag_index, new_tag);
         ++new_tag_index;
       }
       if (num_seqs == 0) {
@@ -1261,22 +2346,55 @@ struct SplitCode {
   }
   
   void addToMap(const std::string& seq, uint32_t index, int dist = 0) {
-    SeqString sstr(seq);
-    if (tags.find(sstr) != tags.end()) {
-      auto& v = tags[sstr];
-      for (auto i : v) {
-        if (i.first == index) {
-          return;
-        }
+    auto& v = tags[SeqString(seq)]; // Single lookup: inserts an empty vector if the sequence is new
+    for (auto i : v) {
+      if (i.first == index) {
+        return;
       }
-      v.reserve(v.size()+1);
-      v.push_back(std::make_pair(index,dist));
-    } else {
-      std::vector<tval> v(0);
-      v.reserve(1);
-      v.push_back(std::make_pair(index,dist));
-      tags.insert({sstr,v});
     }
+    v.reserve(v.size()+1);
+    v.push_back(std::make_pair(index,dist));
+  }
+  
+  static size_t splitFields(const std::string& line, std::vector<std::string>& fields) {
+    // Splits line on whitespace (same tokens as repeated stream extraction) into fields, reusing the existing strings; returns the number of fields
+    size_t n = 0;
+    const char* p = line.c_str();
+    const char* end = p + line.length();
+    while (p < end) {
+      while (p < end && std::isspace(static_cast<unsigned char>(*p))) {
+        p++;
+      }
+      if (p == end) {
+        break;
+      }
+      const char* field_end = p;
+      while (field_end < end && !std::isspace(static_cast<unsigned char>(*field_end))) {
+        field_end++;
+      }
+      if (n == fields.size()) {
+        fields.emplace_back();
+      }
+      fields[n++].assign(p, field_end-p);
+      p = field_end;
+    }
+    return n;
+  }
+  
+  static uint16_t parseFieldUInt16(const std::string& field) {
+    // Leading digits are converted (anything unparseable becomes 0; out-of-range values saturate) like stream extraction would
+    char* end;
+    unsigned long x = std::strtoul(field.c_str(), &end, 10);
+    if (end == field.c_str()) {
+      return 0;
+    }
+    return x > std::numeric_limits<uint16_t>::max() ? std::numeric_limits<uint16_t>::max() : x;
+  }
+  
+  static bool parseFieldBool(const std::string& field) {
+    char* end;
+    long x = std::strtol(field.c_str(), &end, 10);
+    return end != field.c_str() && x != 0;
   }
   
   bool addTags(std::string config_file) {
@@ -1298,6 +2416,7 @@ struct SplitCode {
     std::string line;
     bool header_read = false;
     std::vector<std::string> h;
+    std::vector<std::string> fields;
     while (std::getline(cfile,line)) {
       if (line.size() == 0) {
         continue;
@@ -1305,11 +2424,10 @@ struct SplitCode {
       if (line[0] == '#') {
         continue;
       }
+      size_t n_fields = splitFields(line, fields); // Tokenize the line once (reusing the field buffers across lines)
       if (line[0] == '@') {
-        std::stringstream ss(line);
-        std::string field;
-        std::string value;
-        ss >> field >> value;
+        std::string field = n_fields > 0 ? fields[0] : "";
+        std::string value = n_fields > 1 ? fields[1] : "";
         if (value.empty()) {
           std::cerr << "Error: The file \"" << config_file << "\" contains an invalid line starting with @" << std::endl;
           return false;
@@ -1374,10 +2492,9 @@ struct SplitCode {
         }
         continue;
       }
-      std::stringstream ss(line);
-      std::string field;
       if (!header_read) {
-        while (ss >> field) {
+        for (size_t i = 0; i < n_fields; i++) {
+          std::string field = fields[i];
           std::transform(field.begin(), field.end(), field.begin(), ::toupper);
           h.push_back(field);
         }
@@ -1417,8 +2534,10 @@ struct SplitCode {
       parsePartialStr("", partial5_min_match, partial5_mismatch_freq); // Set up default values
       parsePartialStr("", partial3_min_match, partial3_mismatch_freq); // Set up default values
       bool exclude = false;
+      matcher match = match_neighbors;
       bool ret = true;
-      for (int i = 0; ss >> field; i++) {
+      for (size_t i = 0; i < n_fields; i++) {
+        const std::string& field = fields[i];
         if (h[i] == "BARCODES" || h[i] == "TAGS") {
           bc = field;
         } else if (h[i] == "DISTANCES") {
@@ -1430,22 +2549,22 @@ struct SplitCode {
         } else if (h[i] == "GROUPS") {
           group = field;
         } else if (h[i] == "MINFINDS") {
-          std::stringstream(field) >> min_finds;
+          min_finds = parseFieldUInt16(field);
         } else if (h[i] == "MAXFINDS") {
-          std::stringstream(field) >> max_finds;
+          max_finds = parseFieldUInt16(field);
         } else if (h[i] == "MINFINDSG") {
-          std::stringstream(field) >> min_finds_g;
+          min_finds_g = parseFieldUInt16(field);
         } else if (h[i] == "MAXFINDSG") {
-          std::stringstream(field) >> max_finds_g;
+          max_finds_g = parseFieldUInt16(field);
         } else if (h[i] == "EXCLUDE") {
-          std::stringstream(field) >> exclude;
+          exclude = parseFieldBool(field);
         } else if (h[i] == "SUBS") {
-          std::stringstream(field) >> subs_str;
+          subs_str = field;
         } else if (h[i] == "AFTER" || h[i] == "NEXT") {
-          std::stringstream(field) >> after_str;
+          after_str = field;
           ret = ret && validateBeforeAfterStr(after_str);
         } else if (h[i] == "BEFORE" || h[i] == "PREVIOUS") {
-          std::stringstream(field) >> before_str;
+          before_str = field;
           ret = ret && validateBeforeAfterStr(before_str);
         } else if (h[i] == "LEFT") {
           ret = ret && parseTrimStr(field, trim_left, trim_left_offset);
@@ -1455,6 +2574,8 @@ struct SplitCode {
           ret = ret && parsePartialStr(field, partial5_min_match, partial5_mismatch_freq);
         } else if (h[i] == "PARTIAL3") {
           ret = ret && parsePartialStr(field, partial3_min_match, partial3_mismatch_freq);
+        } else if (h[i] == "MATCH") {
+          ret = ret && parseMatchStr(field, match);
         } else {
           std::cerr << "Error: The file \"" << config_file << "\" contains the invalid column header: " << h[i] << std::endl;
           return false;
@@ -1466,7 +2587,7 @@ struct SplitCode {
       }
       auto trim_dir = trim_left ? left : (trim_right ? right : nodir);
       auto trim_offset = trim_left ? trim_left_offset : (trim_right ? trim_right_offset : 0);
-      if (!ret || !addTag(bc, name.empty() ? bc : name, group, mismatch, indel, total_dist, file, pos_start, pos_end, max_finds, min_finds, exclude, trim_dir, trim_offset, after_str, before_str, partial5_min_match, partial5_mismatch_freq, partial3_min_match, partial3_mismatch_freq, subs_str)) {
+      if (!ret || !addTag(bc, name.empty() ? bc : name, group, mismatch, indel, total_dist, file, pos_start, pos_end, max_finds, min_finds, exclude, trim_dir, trim_offset, after_str, before_str, partial5_min_match, partial5_mismatch_freq, partial3_min_match, partial3_mismatch_freq, subs_str, match)) {
         std::cerr << "Error: The file \"" << config_file << "\" contains an error" << std::endl;
         return false;
       }
@@ -1483,132 +2604,514 @@ struct SplitCode {
   
   bool getTag(std::string& seq, uint32_t& tag_id, int file, int pos, int& k, int& error, int l, bool look_for_initiator = false,
               bool search_tag_name_after = false, bool search_group_after = false, uint32_t search_id_after = -1,
-              bool search_tag_before = false, uint32_t group_curr_ = -1, uint32_t name_id_curr_ = -1, int end_pos_curr = 0) {
-    checkInit();
+              bool search_tag_before = false, uint32_t group_curr_ = -1, uint32_t name_id_curr_ = -1, int end_pos_curr = 0,
+              const TagHits* hits = nullptr, Matcher* matcher = nullptr) {
+    // matcher: processRead()'s scratch for the current read file (its buffers are reused and the align tags' matches are looked up in it)
+    if (!init) { // (processRead() has already initialized; this is for other callers)
+      checkInit();
+    }
+    std::vector<DynamicHit> dynamic_local;
+    auto& dynamic_hits = matcher != nullptr ? matcher->dynamic_hits : dynamic_local; // Matches of tags that aren't in the tags map, probed at k or larger (as expansions would be; sorted by k)
+    dynamic_hits.clear();
+    if (!dynamic_probes.empty()) {
+      matchDynamic(seq, file, pos, k, l, dynamic_hits, matcher);
+    }
     int k_expanded = k;
+    size_t dynamic_i = 0;
+    uint64_t code = 0; // 2-bit code of the first code_k bases at pos (for findKey)
+    int code_k = 0;
     uint32_t updated_tag_id;
     uint32_t updated_name_id;
     int updated_k;
     int updated_error;
     bool found = false;
-    while (k_expanded != -1) {
-      std::cerr << "WITHIN_ATTEMPT_TAG: " << seq << k_expanded << " " << pos << std::endl;
-      bool found_curr = false;
-      uint32_t tag_id_;
-      int error_prev;
-      uint32_t name_id_curr;
-      uint32_t tag_id_curr;
-      int curr_k = k_expanded;
-      k_expanded = -1;
-      const auto& it = tags.find(SeqString(seq.c_str()+pos, curr_k));
-      if (it == tags.end()) {
-      size_t xxxx = tags.size();
-      std::cerr << "BREAK_ATTEMPT_TAG: " << seq << curr_k << " " << pos << " tags.size()=" << xxxx << std::endl;
-        break;
+    bool found_curr;
+    int error_prev = 0;
+    uint32_t name_id_curr = -1;
+    uint32_t tag_id_curr;
+    int curr_k;
+    auto add_candidate = [&](uint32_t tag_id_, int error_) { // Returns false if candidates of length curr_k map to multiple tag names
+      const auto& tag = tag_filters[tag_id_];
+      if (search_tag_name_after && tag.name_id != search_id_after) {
+        return true;
+      } else if (search_group_after && tag.group != search_id_after) {
+        return true;
       }
-      for (auto &x : it->second) {
-        std::cerr << "__WITHIN_ATTEMPT_TAG1: " << x.first << " " << x.second << std::endl;
-        if (x.second == -1) {
-          std::cerr << "__WITHIN_ATTEMPT_TAG_EXPANDED: k_expanded=" << x.first << std::endl;
-          k_expanded = x.first;
-          continue;
+      if (tag.flags & (TagFilter::has_before | TagFilter::has_before_group)) {
+        if (!search_tag_before) {
+          return true;
         }
-        tag_id_ = x.first;
-        auto& tag = tags_vec[tag_id_];
-        if (search_tag_name_after && tag.name_id != search_id_after) {
-          std::cerr << "__WITHIN_ATTEMPT_TAG_A" << std::endl;
-          continue;
-        } else if (search_group_after && tag.group != search_id_after) {
-          std::cerr << "__WITHIN_ATTEMPT_TAG_B" << std::endl;
-          continue;
+        if ((tag.flags & TagFilter::has_before) && tag.id_before != name_id_curr_) {
+          return true;
+        } else if ((tag.flags & TagFilter::has_before_group) && tag.id_before != group_curr_) {
+          return true;
+        } else {
+          if (pos-end_pos_curr < tag.extra_before) {
+            return true;
+          }
+          if (tag.extra_before2 != 0 && pos-end_pos_curr >= tag.extra_before2) {
+            return true;
+          }
         }
-        if (tag.has_before || tag.has_before_group) {
-          std::cerr << "__WITHIN_ATTEMPT_TAG_C" << std::endl;
-          if (!search_tag_before) {
-            continue;
+      }
+      if ((tag.flags & TagFilter::partial5) && pos != 0) {
+        return true;
+      }
+      if ((tag.flags & TagFilter::partial3) && pos+curr_k != l) {
+        return true;
+      }
+      if (containsRegion(tag.file, tag.pos_start, tag.pos_end, file, pos, pos+curr_k, l)) {
+        if (!look_for_initiator || (look_for_initiator && (tag.flags & TagFilter::initiator))) {
+          if (found_curr && tag.name_id != name_id_curr) {
+            found_curr = false; // seq of length curr_k maps to multiple tags of different names
+            return false;
           }
-          if (tag.has_before && tag.id_before != name_id_curr_) {
-            continue;
-          } else if (tag.has_before_group && tag.id_before != group_curr_) {
-            continue;
-          } else {
-            if (pos-end_pos_curr < tag.extra_before) {
+          if (!found_curr || (found_curr && error_prev > error_)) {
+            error_prev = error_;
+            tag_id_curr = tag_id_; // if tags have same name but different mismatch errors: choose the tag w/ smallest error
+          }
+          name_id_curr = tag.name_id;
+          found_curr = true;
+        }
+      }
+      return true;
+    };
+    while (k_expanded != -1 || dynamic_i < dynamic_hits.size()) {
+      found_curr = false;
+      curr_k = k_expanded;
+      if (dynamic_i < dynamic_hits.size() && (curr_k == -1 || dynamic_hits[dynamic_i].k < curr_k)) {
+        curr_k = dynamic_hits[dynamic_i].k;
+      }
+      bool unambiguous = true;
+      if (curr_k == k_expanded) {
+        k_expanded = -1;
+        const KmerTable::Entry* entry = nullptr;
+        const std::vector<tval>* v = hits ? hits->find(pos, curr_k) : findKey(seq, file, pos, curr_k, entry, code, code_k); // (hits: keys in this read were already located by the automaton)
+        if (v == nullptr && dynamic_i == dynamic_hits.size()) {
+          break;
+        }
+        if (entry != nullptr && entry->resolved) { // All the key's tags would pass or fail the checks together, leaving the one with the smallest error
+          k_expanded = entry->expansion;
+          unambiguous = add_candidate(entry->tag_id, entry->error);
+        } else if (v != nullptr) {
+          for (auto &x : *v) {
+            if (x.second == -1) {
+              k_expanded = x.first;
               continue;
             }
-            if (tag.extra_before2 != 0 && pos-end_pos_curr >= tag.extra_before2) {
-              continue;
+            if (!(unambiguous = add_candidate(x.first, x.second))) {
+              break;
+            }
+          }
+        }
+      }
+      for (; dynamic_i < dynamic_hits.size() && dynamic_hits[dynamic_i].k == curr_k; dynamic_i++) {
+        if (unambiguous) {
+          unambiguous = add_candidate(dynamic_hits[dynamic_i].tag_id, dynamic_hits[dynamic_i].error);
+        }
+      }
+      // Algorithm works as follows:
+      // // for a given k, remove that k from consideration if there are multiple tag.name_id's for that k
+      // // however, if there are multiple tags of the same name_id for that k, pick the tag with the smallest error
+      // // afterwards, compare across all k's being considered: if multiple tag.name_id's across different k's, return false (-1), otherwise pick the tag associated with the largest k
+      if (found_curr) {
+        if (!found) { // First time identifying a tag
+          found = true;
+          updated_tag_id = tag_id_curr;
+          updated_k = curr_k;
+          updated_error = error_prev;
+          updated_name_id = name_id_curr;
+        } else { // Already previously identified a tag when looking at a smaller k
+          if (updated_name_id != name_id_curr) {
+            return false; // multiple tags of different names
+          }
+          if (updated_error >= error_prev) { // Choose smallest error first when deciding if to update to larger k
+            updated_tag_id = tag_id_curr;
+            updated_k = curr_k; // Update to larger k
+            updated_error = error_prev;
+            updated_name_id = name_id_curr;
+          }
+        }
+      }
+    }
+    if (found) {
+      tag_id = updated_tag_id;
+      k = updated_k;
+      error = updated_error;
+      return true;
+    }
+    return false;
+  }
+  
+  const KmerIndex* kmerIndex(int file, int k) const {
+    return file < (int)kmer_indices.size() && k < (int)kmer_indices[file].size() && !kmer_indices[file][k].tables.empty() ? &kmer_indices[file][k] : nullptr;
+  }
+  
+  void buildKmerIndices() {
+    // For each file, every k-mer size searched at a fixed position gets tables holding only that file's tags, split at the positions
+    // where tags start or stop fitting (so each lookup only goes through tags that can be found there; expansions are kept everywhere)
+    kmer_indices.assign(kmer_size_locations.size(), std::vector<KmerIndex>());
+    kmer_vectors.clear();
+    for (int file = 0; file < (int)kmer_size_locations.size(); file++) {
+      std::set<int> ks;
+      for (const auto& loc : kmer_size_locations[file]) {
+        if ((loc.second != -1 || learn_n != 0) && loc.first <= 32) { // (unbound k-mers become fixed once locations are learned)
+          ks.insert(loc.first);
+        }
+      }
+      if (ks.empty()) {
+        continue;
+      }
+      std::vector<std::vector<std::pair<uint64_t,const std::vector<tval>*>>> keys(*ks.rbegin()+1); // The tags map entries of each k
+      std::vector<std::set<int>> bounds(keys.size());
+      for (const auto& it : tags) {
+        int k = it.first.length();
+        uint64_t code;
+        if (!ks.count(k) || !KmerTable::encode(it.first.p_ ? it.first.p_ : it.first.s_.c_str(), k, code)) {
+          continue;
+        }
+        bool in_file = false;
+        for (const auto& x : it.second) {
+          const auto& tag = tag_filters[x.first];
+          if (x.second == -1) {
+            in_file = true;
+          } else if (tag.file == file) {
+            in_file = true;
+            if (tag.pos_start >= 0) {
+              bounds[k].insert(tag.pos_start);
+              if (tag.pos_end != 0) {
+                bounds[k].insert(std::max(tag.pos_end-k+1, tag.pos_start));
+              }
+            }
+          }
+        }
+        if (in_file) {
+          keys[k].push_back(std::make_pair(code, &it.second));
+        }
+      }
+      kmer_indices[file].resize(keys.size());
+      for (int k : ks) {
+        auto& index = kmer_indices[file][k];
+        index.starts.assign(1, 0);
+        for (int b : bounds[k]) {
+          if (b > 0) {
+            index.starts.push_back(b);
+          }
+        }
+        auto range = [&](int i, std::vector<std::pair<uint64_t,const std::vector<tval>*>>& entries) { // Entries of keys[k] that can be found in range i
+          entries.clear();
+          int start = index.starts[i];
+          auto found = [&](const tval& x) {
+            const auto& tag = tag_filters[x.first];
+            return x.second == -1 || (tag.file == file && (tag.pos_start < 0 || (tag.pos_start <= start && (tag.pos_end == 0 || start+k <= tag.pos_end))));
+          };
+          for (const auto& key : keys[k]) {
+            size_t n = std::count_if(key.second->begin(), key.second->end(), found);
+            if (n == key.second->size()) {
+              entries.push_back(key);
+            } else if (n != 0) {
+              kmer_vectors.emplace_back(new std::vector<tval>());
+              kmer_vectors.back()->reserve(n);
+              std::copy_if(key.second->begin(), key.second->end(), std::back_inserter(*kmer_vectors.back()), found);
+              entries.push_back(std::make_pair(key.first, kmer_vectors.back().get()));
+            }
+          }
+        };
+        std::vector<std::vector<std::pair<uint64_t,const std::vector<tval>*>>> entries(index.starts.size());
+        size_t n_entries = 0;
+        for (int i = 0; i < (int)index.starts.size() && (int)index.starts.size() <= KmerIndex::MAX_RANGES; i++) {
+          range(i, entries[i]);
+          n_entries += entries[i].size();
+        }
+        if (index.starts.size() > KmerIndex::MAX_RANGES || n_entries > 2*keys[k].size()) {
+          index.starts.assign(1, 0);
+          entries.assign(1, std::vector<std::pair<uint64_t,const std::vector<tval>*>>());
+          for (const auto& key : keys[k]) {
+            entries[0].push_back(key);
+          }
+        }
+        // Tiers are for tables that are mostly neighbors and where every tag has a single position (so lookups mostly hit)
+        bool tiers = 4*tags_vec.size() <= keys[k].size();
+        for (int i = 0; i < (int)tags_vec.size() && tiers; i++) {
+          const auto& tag = tags_vec[i];
+          if ((int)tag.seq.length() >= k && (tag.file == file || tag.file == -1)) {
+            tiers = tag.pos_start >= 0 && tag.pos_end == tag.pos_start+(int)tag.seq.length();
+          }
+        }
+        robin_hood::unordered_flat_set<uint64_t> exact_codes; // Tags' own sequences (or their first k bases, for expansions)
+        for (int i = 0; i < (int)tags_vec.size() && tiers; i++) {
+          const auto& tag = tags_vec[i];
+          uint64_t code;
+          if ((int)tag.seq.length() >= k && (tag.file == file || tag.file == -1) && KmerTable::encode(tag.seq.c_str(), k, code)) {
+            exact_codes.insert(code);
+          }
+        }
+        index.tables.resize(index.starts.size());
+        for (int i = 0; i < (int)index.starts.size(); i++) {
+          int end = i+1 < (int)index.starts.size() ? index.starts[i+1] : -1;
+          std::vector<std::pair<uint64_t,KmerTable::Entry>> table_entries;
+          table_entries.reserve(entries[i].size());
+          for (const auto& e : entries[i]) {
+            table_entries.push_back(std::make_pair(e.first, resolveKey(*e.second, k, index.starts[i], end)));
+            table_entries.back().second.exact = exact_codes.count(e.first) != 0;
+          }
+          index.tables[i].build(k, std::move(table_entries), tiers);
+        }
+      }
+    }
+  }
+  
+  KmerTable::Entry resolveKey(const std::vector<tval>& v, int k, int start, int end) {
+    // Sets up the table entry of a key whose tags are looked up at positions start up to end (-1: no end)
+    KmerTable::Entry e = {&v, 0, 0, -1, true, false};
+    bool found = false;
+    for (const auto& x : v) {
+      if (x.second == -1) {
+        e.expansion = x.first;
+        continue;
+      }
+      const auto& tag = tag_filters[x.first];
+      const auto& best = tag_filters[e.tag_id];
+      bool everywhere = tag.pos_start >= 0 && tag.pos_start <= start && (tag.pos_end == 0 || (end != -1 && end-1+k <= tag.pos_end));
+      if (!everywhere || (tag.flags & ~TagFilter::initiator) != 0 || (found && (tag.name_id != best.name_id || tag.group != best.group || tag.flags != best.flags))) {
+        e.resolved = false;
+      }
+      if (!found || x.second < e.error) {
+        e.tag_id = x.first;
+        e.error = x.second;
+        found = true;
+      }
+    }
+    e.resolved = e.resolved && found;
+    return e;
+  }
+  
+  const std::vector<tval>* findKey(const std::string& seq, int file, int pos, int k, const KmerTable::Entry*& entry, uint64_t& code, int& code_k) {
+    // entry is set if the key was looked up in a k-mer table
+    // code holds the 2-bit code of the code_k bases at pos, so that a key an expansion leads to only encodes the bases it adds
+    // (code_k is -1 once those bases include a non-ACGT base; it starts at 0)
+    const KmerIndex* index = kmerIndex(file, k);
+    entry = nullptr;
+    if (index != nullptr && code_k != -1) {
+      uint64_t added;
+      if (code_k > k) {
+        code_k = 0;
+      }
+      if (KmerTable::encode(seq.c_str()+pos+code_k, k-code_k, added)) {
+        code = code_k == 0 ? added : (code << (2*(k-code_k))) | added;
+        code_k = k;
+        entry = index->table(pos).find(code);
+        return entry == nullptr ? nullptr : entry->v;
+      }
+      code_k = -1;
+    }
+    const auto& it = tags.find(SeqString(seq.c_str()+pos, k));
+    return it == tags.end() ? nullptr : &(it->second);
+  }
+  
+  uint32_t dynamicTagId(const std::pair<probe_type,uint32_t>& probe) const {
+    switch (probe.first) {
+    case probe_align:
+      return align_tags[probe.second].tag_id;
+    case probe_polymer:
+      return polymer_tags[probe.second].tag_id;
+    case probe_whitelist:
+      return whitelists[probe.second].tag_ids[0];
+    default:
+      return partial_tags[probe.second].tag_id;
+    }
+  }
+  
+  void matchDynamic(const std::string& seq, int file, int pos, int k, int l, std::vector<DynamicHit>& hits, const Matcher* matcher = nullptr) {
+    // matcher: if supplied, the align tags' matches were already found by alignRead()
+    for (int probe_k = k; probe_k < (int)dynamic_probes.size(); probe_k++) {
+      for (const auto& p : dynamic_probes[probe_k]) {
+        const auto& tag = tag_filters[dynamicTagId(p)];
+        if (tag.file != file || (tag.pos_start >= 0 && pos < tag.pos_start) || (tag.pos_end != 0 && pos+probe_k > tag.pos_end)) {
+          continue; // Can't match here (the full location check is done when adding candidates)
+        }
+        switch (p.first) {
+        case probe_align:
+          if (matcher != nullptr) {
+            for (int32_t h = matcher->align_start[pos]; h < matcher->align_start[pos+1]; h++) {
+              const auto& x = matcher->align_hits[h];
+              if (x.align_i == p.second) {
+                hits.push_back({x.k, align_tags[x.align_i].tag_id, x.error});
+              }
             }
+          } else {
+            addAlignHits(seq, pos, l, align_tags[p.second], hits);
+          }
+          break;
+        case probe_partial5:
+        case probe_partial3:
+          addPartialHits(seq, pos, l, partial_tags[p.second], p.first == probe_partial5, hits);
+          break;
+        case probe_polymer:
+          addPolymerHits(seq, pos, l, polymer_tags[p.second], hits);
+          break;
+        case probe_whitelist:
+          addWhitelistHits(seq, pos, l, whitelists[p.second], hits);
+          break;
+        }
+      }
+    }
+    std::stable_sort(hits.begin(), hits.end(), [](const DynamicHit& x, const DynamicHit& y) { return x.k < y.k; });
+  }
+  
+  void addAlignHits(const std::string& seq, int pos, int l, const AlignTag& a, std::vector<DynamicHit>& hits) {
+    // Aligns the tag against the read starting at pos and collects every match length within the tag's edit distance
+    int dist[AlignTag::MAX_LEN*2];
+    int kmax = std::min(a.m+a.max_error, l-pos);
+    if (kmax < a.probe_k) {
+      return;
+    }
+    int n = a.align(seq.c_str()+pos, kmax, dist);
+    int exact_end = alignExactEnd(seq, pos, l, a);
+    for (int j = a.probe_k; j <= n; j++) {
+      if (dist[j-1] <= a.max_error && !(j > a.m && j >= exact_end)) {
+        hits.push_back({j, a.tag_id, dist[j-1]});
+      }
+    }
+  }
+  
+  int alignExactEnd(const std::string& seq, int pos, int l, const AlignTag& a) const {
+    // Longer matches that contain the tag itself are left to the exact match (as with enumerated indel neighbors):
+    // returns the end (relative to pos) of the first exact copy of the tag within reach of pos (past the reach if none)
+    int kmax = std::min(a.m+a.max_error, l-pos);
+    for (int o = 0; o+a.m <= kmax; o++) {
+      if (seq.compare(pos+o, a.m, tags_vec[a.tag_id].seq) == 0) {
+        return o+a.m;
+      }
+    }
+    return kmax+1;
+  }
+  
+  void alignRead(const std::string& seq, int file, int l, Matcher& m) const {
+    // Finds the matches of every align tag searched for in file: one free-start pass over the read gives the ends of the matches,
+    // then an anchored pass back from each end gives their starts (the lengths and distances are those addAlignHits() finds)
+    int dist[AlignTag::MAX_LEN*2];
+    m.align_hits.clear();
+    for (uint32_t i = 0; i < align_tags.size(); i++) {
+      const auto& a = align_tags[i];
+      if (tag_filters[a.tag_id].file != file) {
+        continue;
+      }
+      m.align_ends.clear();
+      a.ends(seq.c_str(), l, m.align_ends);
+      for (int e : m.align_ends) {
+        int n = a.align(seq.c_str()+e, std::min(a.m+a.max_error, e), dist, true);
+        for (int j = a.probe_k; j <= n; j++) {
+          if (dist[j-1] <= a.max_error && !(j > a.m && j >= alignExactEnd(seq, e-j, l, a))) {
+            m.align_hits.push_back({e-j, j, i, dist[j-1]});
           }
         }
-        if (tag.partial5 && pos != 0) {
-          std::cerr << "__WITHIN_ATTEMPT_TAG2: (tag.partial5 && pos != 0)" << std::endl;
-          continue;
-        }
-        if (tag.partial3 && pos+curr_k != l) {
-          std::cerr << "__WITHIN_ATTEMPT_TAG_D" << std::endl;
-          continue;
-        }
-        std::cerr << "__WITHIN_ATTEMPT_TAG_E: tag.file=" << tag.file << " tag.pos_start=" << tag.pos_start << " tag.pos_end=" << tag.pos_end << std::endl;
-        std::cerr << "__WITHIN_ATTEMPT_TAG_F: file=" << file << " pos=" << pos << " curr_k=" << curr_k << " l=" << l << std::endl;
-        if (containsRegion(tag.file, tag.pos_start, tag.pos_end, file, pos, pos+curr_k, l)) {
-          std::cerr << "__WITHIN_ATTEMPT_TAG3: tag.file=" << tag.file << " tag.pos_start=" << tag.pos_start << " tag.pos_end=" << tag.pos_end << std::endl;
-          if (!look_for_initiator || (look_for_initiator && tags_vec[tag_id_].initiator)) {
-            if (found_curr && tag.name_id != name_id_curr) {
-              std::cerr << "__WITHIN_ATTEMPT_TAG3_BREAK" << std::endl;
-              found_curr = false; // seq of length curr_k maps to multiple tags of different names
-              break;
-            }
-            if (!found_curr || (found_curr && error_prev > x.second)) {
-              error_prev = x.second;
-              tag_id_curr = tag_id_; // if tags have same name but different mismatch errors: choose the tag w/ smallest error
-            }
-            name_id_curr = tag.name_id;
-            found_curr = true;
-              std::cerr << "__WITHIN_ATTEMPT_TAG3_FOUND_CURR" << name_id_curr << std::endl;
-          }
+      }
+    }
+    std::sort(m.align_hits.begin(), m.align_hits.end(), [](const Matcher::AlignHit& x, const Matcher::AlignHit& y) {
+      return x.pos != y.pos ? x.pos < y.pos : (x.align_i != y.align_i ? x.align_i < y.align_i : x.k < y.k);
+    });
+    m.align_start.assign(l+1, 0);
+    for (const auto& x : m.align_hits) {
+      m.align_start[x.pos+1]++;
+    }
+    for (int pos = 0; pos < l; pos++) {
+      m.align_start[pos+1] += m.align_start[pos];
+    }
+  }
+  
+  void addWhitelistHits(const std::string& seq, int pos, int l, const WhitelistIndex& w, std::vector<DynamicHit>& hits) {
+    // Reports every tag in the whitelist within its distance of the read at pos (in tag order, as they'd be in a tags map entry)
+    if (l-pos < w.m) {
+      return;
+    }
+    uint64_t code, n_mask;
+    WhitelistIndex::encode(seq.c_str()+pos, w.m, code, n_mask);
+    if (n_mask != 0 && random_replacement) {
+      return; // N's aren't neighbors when they're randomly replaced
+    }
+    size_t n = hits.size();
+    w.find(code, n_mask, [&](uint32_t j, int d) {
+      hits.push_back({w.m, w.tag_ids[j], d});
+    });
+    std::sort(hits.begin()+n, hits.end(), [](const DynamicHit& x, const DynamicHit& y) { return x.tag_id < y.tag_id; });
+  }
+  
+  void addPolymerHits(const std::string& seq, int pos, int l, const PolymerTag& p, std::vector<DynamicHit>& hits) {
+    // Extends the run from pos one base at a time, reporting each length in range while mismatches stay within max_error
+    bool use_N = !random_replacement;
+    int kmax = std::min(p.range_end, l-pos);
+    int mismatches = 0;
+    for (int k = 1; k <= kmax; k++) {
+      char c = seq[pos+k-1];
+      if (c != p.base) {
+        if (++mismatches > p.max_error || (c == 'N' && !use_N)) {
+          break;
         }
       }
-      std::cerr << "__WITHIN_ATTEMPT_TAG4:" << found_curr << std::endl;
-      // Algorithm works as follows:
-      // // for a given k, remove that k from consideration if there are multiple tag.name_id's for that k
-      // // however, if there are multiple tags of the same name_id for that k, pick the tag with the smallest error
-      // // afterwards, compare across all k's being considered: if multiple tag.name_id's across different k's, return false (-1), otherwise pick the tag associated with the largest k
-      if (found_curr) {
-      std::cerr << "__WITHIN_ATTEMPT_TAG5:" << found_curr << std::endl;
-        if (!found) { // First time identifying a tag
-          found = true;
-          updated_tag_id = tag_id_curr;
-          updated_k = curr_k;
-          updated_error = error_prev;
-          updated_name_id = name_id_curr;
-        } else { // Already previously identified a tag when looking at a smaller k
-          if (updated_name_id != name_id_curr) {
-            std::cerr << "__WITHIN_ATTEMPT_TAG5_BREAK" << std::endl;
-            return false; // multiple tags of different names
-          }
-          if (updated_error >= error_prev) { // Choose smallest error first when deciding if to update to larger k
-            updated_tag_id = tag_id_curr;
-            updated_k = curr_k; // Update to larger k
-            updated_error = error_prev;
-            updated_name_id = name_id_curr;
-          }
+      if (k >= p.range_begin) {
+        hits.push_back({k, p.tag_id+(k-p.range_begin), mismatches});
+      }
+    }
+  }
+  
+  void addPartialHits(const std::string& seq, int pos, int l, const PartialTag& p, bool partial5, std::vector<DynamicHit>& hits) {
+    // 5′ partial: suffixes of the tag at the start of the read; 3′ partial: prefixes of the tag ending at the end of the read
+    // A match of length k is allowed floor(mismatch_freq*k) mismatches; error = truncated bases + mismatches (0 if no mismatches)
+    const std::string& tag_seq = tags_vec[p.tag_id].seq;
+    int m = tag_seq.length();
+    int kmin = partial5 ? p.min_match : std::max(p.min_match, l-pos);
+    int kmax = std::min(m, l-pos);
+    if ((partial5 && pos != 0) || (!partial5 && kmin != l-pos)) {
+      return;
+    }
+    for (int k = kmin; k <= kmax; k++) {
+      const char* t = tag_seq.c_str() + (partial5 ? m-k : 0);
+      int max_mismatches = floor(p.mismatch_freq*k);
+      int mismatches = 0;
+      for (int i = 0; i < k && mismatches <= max_mismatches; i++) {
+        if (seq[pos+i] != t[i]) {
+          mismatches += (seq[pos+i] == 'N' && random_replacement) ? max_mismatches+1 : 1; // N's aren't neighbors when they're randomly replaced
         }
       }
+      if (mismatches <= max_mismatches) {
+        hits.push_back({k, p.tag_id, mismatches == 0 ? 0 : (m-k)+mismatches});
+      }
     }
-    if (found) {
-      std::cerr << "__WITHIN_ATTEMPT_TAG6:" << tag_id << std::endl;
-      tag_id = updated_tag_id;
-      k = updated_k;
-      error = updated_error;
-      return true;
+  }
+  
+  bool getNameId(const std::string& name, uint32_t& id) {
+    const auto& it = names_map.find(name);
+    if (it == names_map.end()) {
+      return false;
     }
-    return false;
+    id = it->second;
+    return true;
+  }
+  
+  bool getGroupId(const std::string& group_name, uint32_t& id) {
+    const auto& it = group_names_map.find(group_name);
+    if (it == group_names_map.end()) {
+      return false;
+    }
+    id = it->second;
+    return true;
   }
   
   int getNumTags() {
     return tags_vec.size();
   }
   
+  size_t getPlanSize() {
+    checkInit();
+    return plan_size;
+  }
+  
+  double getPlanCompileTime() {
+    checkInit();
+    return plan_compile_time;
+  }
+  
   int getNumTagsOriginallyAdded() {
     return n_tag_entries;
   }
@@ -1631,9 +3134,24 @@ struct SplitCode {
     for (auto& n : idcount) {
       nummapped += n;
     }
+    for (auto& it : radix_counts) {
+      nummapped += it.second;
+    }
     return nummapped;
   }
   
+  static std::vector<std::string> splitString(const std::string& s, char delimeter) {
+    // Same pieces as reading s with std::getline(..., delimeter) but without constructing a stream
+    std::vector<std::string> v;
+    size_t start = 0;
+    while (start < s.length()) {
+      size_t end = std::min(s.find(delimeter, start), s.length());
+      v.push_back(s.substr(start, end-start));
+      start = end+1;
+    }
+    return v;
+  }
+  
   static bool parseTrimStr(const std::string& s_trim, bool& trim, int& offset) {
     trim = false;
     offset = 0;
@@ -1641,11 +3159,11 @@ struct SplitCode {
     if (s_trim.find(',') < s_trim.length()) {
       delimeter = ','; // If string contains commas, use commas as delimeter
     }
-    std::stringstream ss_trim(s_trim);
     std::string trim_attribute;
     int i = 0;
     try {
-      while (std::getline(ss_trim, trim_attribute, delimeter)) {
+      for (const auto& piece : splitString(s_trim, delimeter)) {
+        trim_attribute = piece;
         if (!trim_attribute.empty()) {
           if (i == 0) {
             trim = std::stoi(trim_attribute);
@@ -1677,11 +3195,11 @@ struct SplitCode {
     if (location.find(',') < location.length()) {
       delimeter = ','; // If string contains commas, use commas as delimeter
     }
-    std::stringstream ss_loc(location);
     std::string location_attribute;
     int i = 0;
     try {
-      while (std::getline(ss_loc, location_attribute, delimeter)) {
+      for (const auto& piece : splitString(location, delimeter)) {
+        location_attribute = piece;
         if (!location_attribute.empty()) {
           if (i == 0) {
             file = std::stoi(location_attribute);
@@ -1712,11 +3230,11 @@ struct SplitCode {
       return true;
     }
     char delimeter = ':';
-    std::stringstream ss_dist(distance);
     std::string dist_attribute;
     int i = 0;
     try {
-      while (std::getline(ss_dist, dist_attribute, delimeter)) {
+      for (const auto& piece : splitString(distance, delimeter)) {
+        dist_attribute = piece;
         if (!dist_attribute.empty()) {
           if (i == 0) {
             mismatch = std::stoi(dist_attribute);
@@ -1745,6 +3263,21 @@ struct SplitCode {
     return true;
   }
   
+  static bool parseMatchStr(const std::string& s, matcher& match) {
+    match = match_neighbors;
+    if (s.empty() || s == "0" || s == "neighbors") {
+      return true;
+    } else if (s == "1" || s == "align") {
+      match = match_align;
+      return true;
+    } else if (s == "2" || s == "whitelist") {
+      match = match_whitelist;
+      return true;
+    }
+    std::cerr << "Error: Invalid match method \"" << s << "\" (must be neighbors, align, or whitelist)" << std::endl;
+    return false;
+  }
+  
   static bool parsePartialStr(const std::string& s, int& min_match, double& mismatch_freq) {
     mismatch_freq = 0;
     min_match = 0;
@@ -1752,11 +3285,11 @@ struct SplitCode {
       return true;
     }
     char delimeter = ':';
-    std::stringstream ss(s);
     std::string s_attribute;
     int i = 0;
     try {
-      while (std::getline(ss, s_attribute, delimeter)) {
+      for (const auto& piece : splitString(s, delimeter)) {
+        s_attribute = piece;
         if (!s_attribute.empty()) {
           if (i == 0) {
             min_match = std::stoi(s_attribute);
@@ -1854,12 +3387,12 @@ struct SplitCode {
         if (name.size() == 0) {
           continue;
         }
-        const auto& itnames = std::find(names.begin(), names.end(), name);
-        if (itnames == names.end()) {
+        uint32_t name_id;
+        if (!getNameId(name, name_id)) {
           std::cerr << "Error: File " << mapping_file << " contains the name \"" << name << "\" which does not exist" << std::endl;
           return false;
         }
-        u.push_back(itnames - names.begin());
+        u.push_back(name_id);
       }
       if (idmap_find(u) != -1) {
         std::cerr << "Error: In file " << mapping_file << ", the following is duplicated: " << names_list << std::endl;
@@ -1901,12 +3434,12 @@ struct SplitCode {
         if (name.size() == 0) {
           continue;
         }
-        const auto& itnames = std::find(names.begin(), names.end(), name);
-        if (itnames == names.end()) {
+        uint32_t name_id;
+        if (!getNameId(name, name_id)) {
           std::cerr << "Error: File " << keep_file << " contains the name \"" << name << "\" which does not exist" << std::endl;
           return false;
         }
-        u.push_back(itnames - names.begin());
+        u.push_back(name_id);
       }
       auto it1 = idmapinv_keep.find(u);
       auto it2 = idmapinv_discard.find(u);
@@ -1921,6 +3454,7 @@ struct SplitCode {
         idmapinv_discard.insert({u,0});
         discard_check = true;
       } else {
+        keep_trie.insert(u);
         idmapinv_keep.insert({u,ofile});
         keep_check = true;
       }
@@ -1959,12 +3493,12 @@ struct SplitCode {
         if (name.size() == 0) {
           continue;
         }
-        const auto& itnames = std::find(group_names.begin(), group_names.end(), name);
-        if (itnames == group_names.end()) {
+        uint32_t group_id;
+        if (!getGroupId(name, group_id)) {
           std::cerr << "Error: File " << keep_file << " contains the group name \"" << name << "\" which does not exist" << std::endl;
           return false;
         }
-        u.push_back(itnames - group_names.begin());
+        u.push_back(group_id);
       }
       auto it1 = groupmapinv_keep.find(u);
       auto it2 = groupmapinv_discard.find(u);
@@ -1976,6 +3510,7 @@ struct SplitCode {
         groupmapinv_discard.insert({u,0});
         discard_check_group = true;
       } else {
+        keep_trie_group.insert(u);
         groupmapinv_keep.insert({u,ofile});
         keep_check_group = true;
       }
@@ -1984,12 +3519,11 @@ struct SplitCode {
   }
   
   bool addGroupOptions(std::string group_name, uint16_t max_finds, uint16_t min_finds) {
-    const auto& itnames = std::find(group_names.begin(), group_names.end(), group_name);
-    if (itnames == group_names.end()) {
+    uint32_t i;
+    if (!getGroupId(group_name, i)) {
       std::cerr << "Error: Group name \"" << group_name << "\" does not exist" << std::endl;
       return false;
     }
-    auto i = itnames - group_names.begin();
     if (max_finds > 0) {
       if (max_finds_group_map.find(i) != max_finds_group_map.end() && max_finds_group_map[i] != max_finds) {
         std::cerr << "Error: Group name \"" << group_name << "\" had max finds specified multiple times" << std::endl;
@@ -2201,11 +3735,9 @@ struct SplitCode {
                 this->umi_group_map[id].push_back(umi);
               }
             } else {
-              const auto& itnames = std::find(this->group_names.begin(), this->group_names.end(), name);
-              if (itnames == this->group_names.end()) {
+              if (!this->getGroupId(name, id)) {
                 return false;
               }
-              id = itnames - this->group_names.begin();
             }
           } else {
             if (add_to_vec) {
@@ -2213,11 +3745,9 @@ struct SplitCode {
                 this->umi_name_map[id].push_back(umi);
               }
             } else {
-              const auto& itnames = std::find(this->names.begin(), this->names.end(), name);
-              if (itnames == this->names.end()) {
+              if (!this->getNameId(name, id)) {
                 return false;
               }
-              id = itnames - this->names.begin();
             }
           }
         } else if (add_to_vec) {
@@ -2283,11 +3813,24 @@ struct SplitCode {
     }
   }
   
+  struct CompiledPlan { // A file's search plan laid out for one read length by compiledLocations()
+    std::vector<std::pair<int,int>> locs; // Every location in order (all of which fit)
+    std::vector<int32_t> first_at; // Index in locs of the first location at each position (-1 if none; empty if locs isn't in position order)
+  };
+  
   class Locations {
   public:
-    Locations(std::vector<std::pair<int,int>>& kmers, int rlen) : kmers(kmers), size(kmers.size()), rlen(rlen) {
+    // compiled: kmers is a plan already laid out for rlen by compiledLocations() (every location in order, all of which fit)
+    // hits: if supplied (with the plan's first_at), only the locations where a key of that length starts are visited
+    Locations(const std::vector<std::pair<int,int>>& kmers, int rlen, bool compiled = false, const int32_t* first_at = nullptr,
+              const TagHits* hits = nullptr) : kmers(kmers), size(kmers.size()), rlen(rlen), compiled(compiled), first_at(first_at), hits(hits) {
       invalid = false;
       jump_pos = 0;
+      pos = -1;
+      unbound_start = size;
+      while (!compiled && unbound_start > 0 && kmers[unbound_start-1].second == -1) {
+        unbound_start--;
+      }
       i = -1;
       operator++();
     };
@@ -2296,28 +3839,46 @@ struct SplitCode {
       if (invalid) {
         return;
       }
+      if (hits != nullptr) {
+        nextHit();
+        return;
+      }
+      if (compiled) {
+        while (++i < size && kmers[i].second < jump_pos);
+        invalid = i >= size;
+        if (!invalid) {
+          pos = kmers[i].second;
+        }
+        return;
+      }
       int kmer_size;
       int kmer_loc;
       if (i != -1) {
         kmer_size = kmers[i].first;
         kmer_loc = kmers[i].second;
-        if (kmer_loc == -1) {
+        if (kmer_loc == -1) { // Unbound k-mers: at each position, go through every unbound k-mer size
           if (pos < jump_pos) {
             pos = jump_pos;
-          } else {
+            i = unbound_start;
+          } else if (++i == size) {
             pos++;
+            i = unbound_start;
           }
-          if (pos+kmer_size <= rlen) {
-            return;
-          }
+          nextUnbound();
+          return;
         }
       }
       i++;
       while (i < size) {
         kmer_size = kmers[i].first;
         kmer_loc = kmers[i].second;
-        if (kmer_loc == -1) {
-          operator++();
+        if (kmer_loc == -1) { // Progress to the end of the read starting after the last bound location
+          if (pos < jump_pos) {
+            pos = jump_pos;
+          } else {
+            pos++;
+          }
+          nextUnbound();
           return;
         }
         pos = kmer_loc;
@@ -2348,50 +3909,127 @@ struct SplitCode {
     }
 
   private:
+    void nextHit() { // Goes through the positions where the automaton found keys (a position's locations are consecutive in the plan)
+      int p = pos;
+      while (++i < size && kmers[i].second == p) { // The rest of the locations at p
+        if (p >= jump_pos && hits->find(p, kmers[i].first) != nullptr) {
+          return;
+        }
+      }
+      for (p = std::max(p+1, jump_pos); p < rlen; p++) {
+        if (hits->heads[p] == -1 || first_at[p] == -1) {
+          continue;
+        }
+        for (i = first_at[p]; i < size && kmers[i].second == p; i++) {
+          if (hits->find(p, kmers[i].first) != nullptr) {
+            pos = p;
+            return;
+          }
+        }
+      }
+      invalid = true;
+    }
+    
+    void nextUnbound() { // Unbound k-mer sizes are sorted in ascending order
+      while (pos+kmers[unbound_start].first <= rlen) {
+        if (pos+kmers[i].first <= rlen) {
+          return;
+        }
+        pos++;
+        i = unbound_start;
+      }
+      invalid = true;
+    }
+
     const std::vector<std::pair<int,int>>& kmers;
     const int size;
     const int rlen;
+    const bool compiled;
+    const int32_t* first_at;
+    const TagHits* hits;
     int i;
     int pos;
     int jump_pos;
+    int unbound_start;
     bool invalid;
   };
   
-  void doUMIExtraction(std::string& seq, int pos, int k, int file, int readLength, std::map<int16_t, std::vector<int32_t>>& umi_seen, std::map<int16_t, std::vector<int32_t>>& umi_seen_copy,
-                       std::vector<std::string>& umi_data, uint32_t tag_name_id, uint32_t tag_group_id, std::pair<int16_t,int32_t> location = std::make_pair(-1,-1)) {
+  const CompiledPlan* compiledLocations(int file, int rlen) {
+    // Returns kmer_size_locations[file] laid out for reads of length rlen (compiled on first use); nullptr if rlen is too long to keep plans for
+    if (rlen > MAX_COMPILED_RLEN) {
+      return nullptr;
+    }
+    const auto* compiled = compiled_locations[file][rlen].load(std::memory_order_acquire);
+    if (compiled != nullptr) {
+      return compiled;
+    }
+    std::lock_guard<std::mutex> lock(compiled_locations_mutex);
+    compiled = compiled_locations[file][rlen].load(std::memory_order_relaxed);
+    if (compiled == nullptr) {
+      std::unique_ptr<CompiledPlan> v(new CompiledPlan());
+      for (Locations locations(kmer_size_locations[file], rlen); locations.good(); ++locations) {
+        v->locs.push_back(locations.get());
+      }
+      v->first_at.assign(rlen, -1);
+      for (int i = v->locs.size()-1; i >= 0; i--) {
+        int pos = v->locs[i].second;
+        if (i+1 < (int)v->locs.size() && pos > v->locs[i+1].second) {
+          v->first_at.clear(); // Not in position order
+          break;
+        }
+        v->first_at[pos] = i;
+      }
+      compiled = v.get();
+      compiled_locations_storage.push_back(std::move(v));
+      compiled_locations[file][rlen].store(compiled, std::memory_order_release);
+    }
+    return compiled;
+  }
+  
+  void doUMIExtraction(const std::string& seq, int pos, int k, int file, int readLength, UMIAnchors& anchors,
+                       std::vector<std::string>& umi_data, uint32_t tag_name_id, uint32_t tag_group_id, const std::vector<UMI>* umi_vec_location = nullptr) {
+    // k == 0: extraction at a location (the UMIs in umi_vec_location); otherwise, at a tag found at pos
     auto extract_no_chain = this->extract_no_chain;
-    auto revcomp = [](const std::string s) {
-      std::string r(s);
-      std::transform(s.rbegin(), s.rend(), r.begin(), [](char c) {
-        switch(c) {
-        case 'A': return 'T';
-        case 'C': return 'G';
-        case 'G': return 'C';
-        case 'T': return 'A';
-        default: return 'N';
-        }
-        return 'N';
-      });
-      return r;
-    };
-    auto addToUmiData = [extract_no_chain, &umi_data, &revcomp](const UMI& u, const std::string& extracted_umi) {
-      umi_data[u.name_id] += extract_no_chain && !umi_data[u.name_id].empty() ? "" : (!u.rev_comp ? extracted_umi : revcomp(extracted_umi));
+    auto addToUmiData = [extract_no_chain, &umi_data, &seq](const UMI& u, int start, int len) { // Appends seq[start, start+len)
+      auto& d = umi_data[u.name_id];
+      if (extract_no_chain && !d.empty()) {
+        return;
+      }
+      size_t d_len = d.length();
+      d.append(seq, start, len);
+      if (u.rev_comp) {
+        std::reverse(d.begin()+d_len, d.end());
+        std::transform(d.begin()+d_len, d.end(), d.begin()+d_len, [](char c) {
+          switch(c) {
+          case 'A': return 'T';
+          case 'C': return 'G';
+          case 'G': return 'C';
+          case 'T': return 'A';
+          default: return 'N';
+          }
+        });
+      }
     };
 
-    const auto& umi_vec_name = umi_name_map.find(tag_name_id) != umi_name_map.end() ? umi_name_map[tag_name_id] : std::vector<UMI>(0);
-    auto umi_vec_name_size = umi_vec_name.size();
-    const auto& umi_vec_group = umi_group_map.find(tag_group_id) != umi_group_map.end() ? umi_group_map[tag_group_id] : std::vector<UMI>(0);
-    auto umi_vec_group_size = umi_vec_group.size();
     bool use_location = (k == 0);
-    if (use_location) {
-      umi_vec_name_size = 0;
-      umi_vec_group_size = 0;
+    const UMI* umi_vec_name = nullptr;
+    const UMI* umi_vec_group = nullptr;
+    size_t umi_vec_name_size = 0;
+    size_t umi_vec_group_size = 0;
+    if (!use_location) {
+      if ((size_t)tag_name_id+1 < umi_name_start.size()) {
+        umi_vec_name = umi_actions.data()+umi_name_start[tag_name_id];
+        umi_vec_name_size = umi_name_start[tag_name_id+1]-umi_name_start[tag_name_id];
+      }
+      if ((size_t)tag_group_id+1 < umi_group_start.size()) {
+        umi_vec_group = umi_actions.data()+umi_group_start[tag_group_id];
+        umi_vec_group_size = umi_group_start[tag_group_id+1]-umi_group_start[tag_group_id];
+      }
     }
-    const auto& umi_vec_location = use_location ? (umi_loc_map.find(location) != umi_loc_map.end() ? umi_loc_map[location] : std::vector<UMI>(0)) : std::vector<UMI>(0);
-    size_t umi_vec_location_size = umi_vec_location.size();
+    size_t umi_vec_location_size = use_location && umi_vec_location != nullptr ? umi_vec_location->size() : 0;
     for (int i = 0; i < umi_vec_name_size+umi_vec_group_size+umi_vec_location_size; i++) {
       bool group = (i >= umi_vec_name_size);
-      const auto &u = use_location ? (umi_vec_location[i]) : (!group ? umi_vec_name[i] : umi_vec_group[i-umi_vec_name_size]);
+      const auto &u = use_location ? (*umi_vec_location)[i] : (!group ? umi_vec_name[i] : umi_vec_group[i-umi_vec_name_size]);
       auto tag_id = !group ? tag_name_id : tag_group_id;
       if (u.id1_present && u.id1 == tag_id && u.group1 == group && !use_location) {
         if (!u.id2_present) {
@@ -2408,16 +4046,15 @@ struct SplitCode {
               }
             }
             if (extract_len != 0) {
-              std::string extracted_umi = seq.substr(extract_start, extract_len);
-              addToUmiData(u, extracted_umi);
+              addToUmiData(u, extract_start, extract_len);
             }
           } else { // Second location present; push_back the UMI onto the "seen" list to mark that the first barcode was read
             if (u.location2.first == file) { // Make sure correct file
-              umi_seen[u.id].push_back(pos+k);
+              anchors.open(u.id, pos+k);
             }
           }
         } else { // Second barcode present; push_back the UMI onto the "seen" list to mark that the first barcode was read
-          umi_seen[u.id].push_back(pos+k);
+          anchors.open(u.id, pos+k);
         }
       }
       if (u.id2_present && u.id2 == tag_id && u.group2 == group && !use_location) {
@@ -2435,8 +4072,7 @@ struct SplitCode {
               }
             }
             if (extract_len != 0) {
-              std::string extracted_umi = seq.substr(extract_start-extract_len, extract_len);
-              addToUmiData(u, extracted_umi);
+              addToUmiData(u, extract_start-extract_len, extract_len);
             }
           } else {
             // [location]<umi[length_range_start-length_range_end]>[padding]{bc}: extract the UMI between location and barcode
@@ -2462,13 +4098,16 @@ struct SplitCode {
               extract_len = 0;
             }
             if (extract_len != 0) {
-              std::string extracted_umi = seq.substr(extract_start_left, extract_len);
-              addToUmiData(u, extracted_umi);
+              addToUmiData(u, extract_start_left, extract_len);
             }
           }
         } else { // UMI is sandwiched between two barcodes
           // {bc1}[padding_left]<umi[length_range_start-length_range_end]>[padding_right]{bc2}
-          for (auto p : umi_seen_copy[u.id]) {
+          for (size_t a = 0; a < anchors.anchors.size(); a++) {
+            if (!anchors.visible(a, u.id)) {
+              continue;
+            }
+            auto p = anchors.anchors[a].pos;
             auto extract_start_left = p+u.padding_left;
             auto extract_start_right = pos-u.padding_right;
             auto extract_len = u.length_range_end;
@@ -2487,14 +4126,8 @@ struct SplitCode {
               extract_len = 0; // The extraction is too short, so we don't extract UMI
             }
             if (extract_len != 0) {
-              std::string extracted_umi = seq.substr(extract_start_left, extract_len);
-              addToUmiData(u, extracted_umi);
-              // Remove UMI from seen list:
-              auto& mm = umi_seen[u.id];
-              auto it = std::find(mm.begin(), mm.end(), p);
-              if (it != mm.end()) {
-                mm.erase(it);
-              }
+              addToUmiData(u, extract_start_left, extract_len);
+              anchors.close(u.id, p); // Remove UMI from seen list
             }
           }
         }
@@ -2516,14 +4149,13 @@ struct SplitCode {
                 }
               }
               if (extract_len != 0) {
-                std::string extracted_umi = seq.substr(extract_start, extract_len);
-                addToUmiData(u, extracted_umi);
+                addToUmiData(u, extract_start, extract_len);
               }
             } else {
               // Do nothing
             }
           } else { // Second barcode present
-            //umi_seen[u.id].push_back(pos+k); // Not necessary to do
+            //anchors.open(u.id, pos+k); // Not necessary to do
           }
         }
         if (u.location2.first != -1 && u.location2.second == pos && !u.id2_present) {
@@ -2544,8 +4176,7 @@ struct SplitCode {
                 }
               }
               if (extract_len != 0) {
-                std::string extracted_umi = seq.substr(extract_start-extract_len, extract_len);
-                addToUmiData(u, extracted_umi);
+                addToUmiData(u, extract_start-extract_len, extract_len);
               }
             } else { // UMI is sandwiched between two locations
               auto p = u.location1.second;
@@ -2570,12 +4201,15 @@ struct SplitCode {
                 extract_len = 0; // Our extraction point is too far right, so we don't extract UMI
               }
               if (extract_len != 0) {
-                std::string extracted_umi = seq.substr(extract_start_left, extract_len);
-                addToUmiData(u, extracted_umi);
+                addToUmiData(u, extract_start_left, extract_len);
               }
             }
           } else { // UMI is sandwiched between a barcode (1st) and location (2nd)
-            for (auto p : umi_seen_copy[u.id]) {
+            for (size_t a = 0; a < anchors.anchors.size(); a++) {
+              if (!anchors.visible(a, u.id)) {
+                continue;
+              }
+              auto p = anchors.anchors[a].pos;
               auto extract_start_left = p+u.padding_left;
               auto extract_start_right = pos-u.padding_right;
               auto extract_len = u.length_range_end;
@@ -2597,14 +4231,8 @@ struct SplitCode {
                 extract_len = 0; // Our extraction point is too far right, so we don't extract UMI
               }
               if (extract_len != 0) {
-                std::string extracted_umi = seq.substr(extract_start_left, extract_len);
-                addToUmiData(u, extracted_umi);
-                // Remove UMI from seen list:
-                auto& mm = umi_seen[u.id];
-                auto it = std::find(mm.begin(), mm.end(), p);
-                if (it != mm.end()) {
-                  mm.erase(it);
-                }
+                addToUmiData(u, extract_start_left, extract_len);
+                anchors.close(u.id, p); // Remove UMI from seen list
               }
             }
           }
@@ -2681,31 +4309,285 @@ struct SplitCode {
     return std::make_pair(trim_5,trim_3);
   }
   
+  void processBatch(std::vector<std::pair<const char*, int>>& seqs, std::vector<std::pair<const char*, int>>& quals, int jmax, std::vector<Results>& rv, bool use_quals = true,
+                    ResultCache* cache = nullptr, Matcher* matcher = nullptr) {
+    // Processes all reads in seqs (jmax sequences per read) in groups of PREFETCH_READS reads:
+    // before each group is processed, the lookups at the start of its reads are prefetched
+    // cache: if supplied (and results are cacheable), reads whose searched bytes were seen recently reuse those results
+    // matcher: if supplied, the per-read buffers are kept in it (and reused by the next batch)
+    Matcher matcher_local;
+    Matcher* m = matcher != nullptr ? matcher : &matcher_local;
+    std::vector<const char*> s(jmax, nullptr);
+    std::vector<int> l(jmax, 0);
+    std::vector<const char*> q(use_quals ? jmax : 0, nullptr);
+    size_t n_reads = seqs.size()/jmax;
+    bool use_learned = learned.load(std::memory_order_acquire);
+    bool learning = learn_n != 0 && !use_learned;
+    std::vector<std::pair<int,std::pair<int,int>>> found_locations; // file, start, end of every tag found while learning
+    size_t n_learned_reads = 0; // Reads searched using the learned locations
+    std::vector<size_t> learned_misses(use_learned ? kmer_size_locations.size() : 0, 0); // [file] = reads that needed a full search because of it
+    auto load_read = [&](size_t i) {
+      for (int j = 0; j < jmax; j++) {
+        s[j] = seqs[i+j].first;
+        l[j] = seqs[i+j].second;
+        if (use_quals) {
+          q[j] = quals[i+j].first;
+        }
+      }
+    };
+    bool use_cache = cache != nullptr && cache->capacity > 0 && resultsCacheable();
+    std::string key;
+    size_t cache_n_hits_start = use_cache ? cache->n_hits : 0;
+    size_t cache_n_lookups_start = use_cache ? cache->n_lookups : 0;
+    rv.reserve(rv.size()+n_reads);
+    for (size_t g = 0; g < n_reads; g += PREFETCH_READS) {
+      size_t g_end = std::min(g+PREFETCH_READS, n_reads);
+      if (!use_cache) {
+        prefetchLookups(seqs, jmax, g, g_end);
+      }
+      for (size_t r = g; r < g_end; r++) {
+        size_t i = r*jmax;
+        load_read(i);
+        Results results;
+        const Results* cached = nullptr;
+        if (use_cache) {
+          resultCacheKey(s, l, jmax, key);
+          cached = cache->find(key);
+        }
+        if (cached != nullptr) {
+          results = *cached;
+        } else {
+          processRead(s, l, jmax, results, q, use_learned, learning ? &found_locations : nullptr, m);
+          n_learned_reads += use_learned;
+          if (results.learned_miss != -1) { // Fall back to searching the full read
+            learned_misses[results.learned_miss]++;
+            load_read(i);
+            results = Results();
+            processRead(s, l, jmax, results, q, false, nullptr, m);
+            learn_n_fallback++;
+          }
+          if (n_learned_reads == LEARN_TRIAL_READS) { // (Checked every so often rather than once per batch)
+            updateLearnedFallback(n_learned_reads, learned_misses);
+            n_learned_reads = 0;
+            std::fill(learned_misses.begin(), learned_misses.end(), 0);
+          }
+          if (use_cache) {
+            cache->insert(key, results);
+          }
+        }
+        if (use_cache && cache->n_lookups == CACHE_TRIAL_LOOKUPS && cache->n_hits < CACHE_TRIAL_LOOKUPS*CACHE_MIN_HIT_RATE) {
+          cache_n_hits += cache->n_hits-cache_n_hits_start;
+          cache_n_lookups += cache->n_lookups-cache_n_lookups_start;
+          *cache = ResultCache(); // Not worth it: the searched bases hardly ever repeat
+          use_cache = false;
+        }
+        if (isAssigned(results)) { // Only modify/trim the reads stored in seq if assigned
+          modifyRead(seqs, quals, i, results, true);
+        }
+        rv.push_back(results);
+      }
+    }
+    if (learning) {
+      learnLocations(found_locations, n_reads);
+    }
+    if (use_learned) {
+      updateLearnedFallback(n_learned_reads, learned_misses);
+    }
+    if (use_cache) {
+      cache_n_hits += cache->n_hits-cache_n_hits_start;
+      cache_n_lookups += cache->n_lookups-cache_n_lookups_start;
+    }
+  }
+  
+  bool resultsCacheable() {
+    checkInit();
+    return results_cacheable;
+  }
+  
+  bool usesRadixIds() {
+    checkInit();
+    return radix_ids;
+  }
+  
+  void resultCacheKey(const std::vector<const char*>& s, const std::vector<int>& l, int jmax, std::string& key) const {
+    // The length of each read followed by the bytes at its start that the search can look at
+    key.clear();
+    for (int j = 0; j < jmax; j++) {
+      key.append(reinterpret_cast<const char*>(&l[j]), sizeof(l[j]));
+      if (j < (int)cache_region.size()) {
+        key.append(s[j], std::min(l[j], cache_region[j]));
+      }
+    }
+  }
+  
+  size_t getCacheHits() const {
+    return cache_n_hits;
+  }
+  
+  size_t getCacheLookups() const {
+    return cache_n_lookups;
+  }
+  
+  void learnLocations(const std::vector<std::pair<int,std::pair<int,int>>>& found_locations, size_t n_reads) {
+    // Adds the locations of tags found in n_reads reads; once learn_n reads are in, unbound searches are restricted to where tags were found
+    std::lock_guard<std::mutex> lock(learn_mutex);
+    if (learned) {
+      return;
+    }
+    learn_hist.resize(kmer_size_locations.size());
+    learn_hist_end.resize(kmer_size_locations.size());
+    for (const auto& f : found_locations) {
+      auto& hist = learn_hist[f.first];
+      hist.resize(std::max(hist.size(), (size_t)f.second.first+1), 0);
+      hist[f.second.first]++;
+      auto& hist_end = learn_hist_end[f.first];
+      hist_end.resize(std::max(hist_end.size(), (size_t)f.second.second+1), 0);
+      hist_end[f.second.second]++;
+    }
+    learn_n_seen += n_reads;
+    if (learn_n_seen < learn_n) {
+      return;
+    }
+    learned_kmer_size_locations.assign(kmer_size_locations.size(), std::vector<std::pair<int,int>>(0));
+    learned_files.reset(new std::atomic<bool>[kmer_size_locations.size()]);
+    learn_file_searched.assign(kmer_size_locations.size(), 0);
+    learn_file_fallback.assign(kmer_size_locations.size(), 0);
+    for (int i = 0; i < (int)kmer_size_locations.size(); i++) {
+      const auto& kmers = kmer_size_locations[i];
+      auto window = learnedWindow(i, learn_margin);
+      learned_files[i] = false;
+      if (window.first == -1 || kmers.empty() || kmers.back().second != -1) {
+        continue; // Only searches that sweep the whole read are restricted
+      }
+      // Keep every bound location and lay out the (k-mer size, position) pairs that the sweep would visit within the window as fixed locations
+      auto& learned_kmers = learned_kmer_size_locations[i];
+      int sweep_start = 0; // (The sweep starts after the last bound location)
+      size_t unbound_start = kmers.size();
+      while (unbound_start > 0 && kmers[unbound_start-1].second == -1) {
+        unbound_start--;
+      }
+      for (size_t j = 0; j < unbound_start; j++) {
+        learned_kmers.push_back(kmers[j]);
+        sweep_start = kmers[j].second+1;
+      }
+      for (int pos = std::max(sweep_start, window.first); pos <= window.second; pos++) {
+        for (size_t j = unbound_start; j < kmers.size(); j++) {
+          learned_kmers.push_back(std::make_pair(kmers[j].first, pos));
+        }
+      }
+      learned_files[i] = true;
+    }
+    learned.store(true, std::memory_order_release);
+  }
+  
+  void updateLearnedFallback(size_t n_reads, const std::vector<size_t>& misses) {
+    // Adds the reads searched using the learned locations (and, for each file, how many needed a full search because of it);
+    // a file whose reads keep needing full searches goes back to its full search plan
+    std::lock_guard<std::mutex> lock(learn_mutex);
+    for (int i = 0; i < (int)misses.size(); i++) {
+      if (!learned_files[i]) {
+        continue;
+      }
+      learn_file_searched[i] += n_reads;
+      learn_file_fallback[i] += misses[i];
+      if (learn_file_searched[i] >= LEARN_TRIAL_READS && learn_file_fallback[i] > learn_file_searched[i]*LEARN_MAX_FALLBACK_RATE) {
+        learned_files[i] = false; // Searching twice costs more than restricting saves
+      }
+    }
+  }
+  
+  std::pair<int,int> learnedWindow(int file, int margin) const {
+    // Start positions of tags found in file while learning (widened by margin); -1 if none were found
+    auto range = file < (int)learn_hist.size() ? histogramRange(learn_hist[file]) : std::make_pair(-1,-1);
+    return range.first == -1 ? range : std::make_pair(std::max(range.first-margin, 0), range.second+margin);
+  }
+  
+  static std::pair<int,int> histogramRange(const std::vector<size_t>& hist) {
+    // First and last nonzero bins, leaving out the rarest LEARN_OUTLIER_FRACTION of counts on either end; -1 if empty
+    size_t total = 0;
+    for (auto n : hist) {
+      total += n;
+    }
+    if (total == 0) {
+      return std::make_pair(-1,-1);
+    }
+    size_t n_outliers = total*LEARN_OUTLIER_FRACTION;
+    int first = 0;
+    int last = hist.size()-1;
+    for (size_t n = hist[first]; n <= n_outliers; n += hist[++first]);
+    for (size_t n = hist[last]; n <= n_outliers; n += hist[--last]);
+    return std::make_pair(first, last);
+  }
+  
+  void prefetchLookups(const std::vector<std::pair<const char*, int>>& seqs, int jmax, size_t read_start, size_t read_end) {
+    // Prefetches, for reads read_start to read_end-1, the k-mer table slots of the first k-mers searched at fixed positions
+    // (processRead() then does the lookups themselves, by which time the slots of the whole group are on their way)
+    checkInit();
+    if (kmer_indices.empty()) {
+      return;
+    }
+    int n_files = std::min(jmax, (int)kmer_size_locations.size());
+    for (size_t r = read_start; r < read_end; r++) {
+      for (int file = 0; file < n_files; file++) {
+        const char* seq = seqs[r*jmax+file].first;
+        int len = seqs[r*jmax+file].second;
+        int trim_5 = std::min(trim_5_3_vec[file].first, len);
+        int n_file_probes = 0;
+        for (const auto& loc : kmer_size_locations[file]) {
+          if (loc.second == -1 || n_file_probes >= PREFETCH_PROBES) {
+            break;
+          }
+          uint64_t code;
+          int k = loc.first;
+          const KmerIndex* index = kmerIndex(file, k);
+          if (index != nullptr && trim_5+loc.second+k <= len && KmerTable::encode(seq+trim_5+loc.second, k, code)) {
+            __builtin_prefetch(index->table(loc.second).slotAddress(code));
+            n_file_probes++;
+          }
+        }
+      }
+    }
+  }
+  
   void processRead(std::vector<const char*>& s, std::vector<int>& l, int jmax, Results& results) {
     std::vector<const char*> q(0);
     processRead(s, l, jmax, results, q);
   }
   
-  void processRead(std::vector<const char*>& s, std::vector<int>& l, int jmax, Results& results, std::vector<const char*>& q) {
+  void processRead(std::vector<const char*>& s, std::vector<int>& l, int jmax, Results& results, std::vector<const char*>& q,
+                   bool use_learned = false, std::vector<std::pair<int,std::pair<int,int>>>* found_locations = nullptr,
+                   Matcher* matcher = nullptr) {
     // Note: s and l may end up being trimmed/modified (even if the read ends up becoming unassigned)
+    // use_learned: search only the learned locations (results.learned_miss is set to the file if nothing is found there)
+    // found_locations: if supplied, the location of every tag found is added to it
+    // matcher: if supplied, its buffers are reused instead of allocating new ones for this read
+    checkInit();
+    Matcher matcher_local;
+    Matcher& m = matcher != nullptr ? *matcher : matcher_local;
     results.id = -1;
+    results.learned_miss = -1;
     results.discard = false;
     results.passes_filter = true;
-    auto min_finds = min_finds_map; // copy
-    auto max_finds = max_finds_map; // copy
-    auto min_finds_group = min_finds_group_map; // copy
-    auto max_finds_group = max_finds_group_map; // copy
+    if (count_finds) {
+      m.resetFinds(tags_vec.size(), group_names.size());
+    }
+    int n_min_met = 0; // minFinds and minFindsG limits met so far
     bool check_group = keep_check_group || discard_check_group;
     auto it_umi_loc = umi_loc_map.begin();
-    std::vector<uint32_t> group_v(0);
-    if (check_group) {
-      group_v.reserve(16);
-    }
+    auto& group_v = m.group_v;
+    group_v.clear();
     auto& umi_data = results.umi_data;
     if (do_extract) {
       umi_data.resize(umi_names.size());
     }
     int n = std::min(jmax, (int)kmer_size_locations.size());
+    auto& caps_left = m.caps_left;
+    if (use_file_caps) {
+      caps_left.assign(file_caps.begin(), file_caps.end());
+    }
+    auto& tag_hits = m.tag_hits;
+    bool prune = keep_pruning && found_locations == nullptr; // (Learning needs every tag)
+    int keep_node = 0, keep_node_group = 0; // Position in keep_trie and keep_trie_group
     results.og_len.reserve(jmax);
     results.og_len.assign(l.begin(), l.begin()+jmax); 
     for (int j = 0; j < jmax; j++) {
@@ -2739,7 +4621,8 @@ struct SplitCode {
       }
       readLength = l[file];
       bool look_for_initiator = initiator_files[file];
-      std::string seq(s[file], readLength);
+      auto& seq = m.seq;
+      seq.assign(s[file], readLength);
       bool found_weird_base = false; // non-ATCG bases
       uint32_t rando;
       for (auto& c: seq) {
@@ -2757,12 +4640,16 @@ struct SplitCode {
           }
         }
       }
-      std::map<int16_t, std::vector<int32_t>> umi_seen; // int16_t: UMI id; int32_t: position
-      bool umi_loc_check_end = false;
+      auto& umi_anchors = m.umi_anchors;
+      umi_anchors.clear();
+      const std::vector<UMI>* umi_loc_end = nullptr; // UMIs extracted at the end of the read (location -1)
       int left_trim = 0;
       int right_trim = 0;
       bool right_trim_found = false;
-      auto& kmers = kmer_size_locations[file];
+      bool learned_file = use_learned && learned_files[file];
+      const auto* plan = learned_file ? nullptr : compiledLocations(file, readLength);
+      auto& kmers = learned_file ? learned_kmer_size_locations[file] : (plan ? plan->locs : kmer_size_locations[file]);
+      bool found_in_file = false;
       bool search_tag_before = false;
       uint32_t group_curr = std::numeric_limits<uint32_t>::max();
       uint32_t name_id_curr = std::numeric_limits<uint32_t>::max();
@@ -2771,23 +4658,43 @@ struct SplitCode {
       uint32_t search_id_after;
       uint16_t search_extra_after;
       uint16_t search_extra_after2;
+      int search_max_k = 0; // Longest sequence that the tag name or group being searched for can match
       int search_after_start;
-      for (Locations locations(kmers, readLength); locations.good(); ++locations) {
+      const TagHits* hits = nullptr;
+      if (automaton_files[file] && !learned_file) {
+        if (!shift_and_matcher.empty()) {
+          shift_and_matcher.scan(seq, tags, tag_hits);
+        } else {
+          tag_automaton.scan(seq, tag_hits);
+        }
+        hits = &tag_hits;
+      }
+      bool search_file = !(use_file_caps && caps_left[file] == 0); // (Limits may have been used up by tags found in previous files)
+      if (search_file && dynamic_files[file] && !align_tags.empty()) {
+        alignRead(seq, file, readLength, m);
+      }
+      // Only the locations where the automaton found a key of that length can have a tag (unless tags outside the tags map are searched for)
+      bool hits_only = hits != nullptr && !dynamic_files[file];
+      bool skip_no_hits = hits_only && (plan == nullptr || plan->first_at.empty());
+      const TagHits* plan_hits = hits_only && !skip_no_hits ? hits : nullptr;
+      for (Locations locations(kmers, readLength, plan != nullptr, plan_hits ? plan->first_at.data() : nullptr, plan_hits);
+           search_file && locations.good(); ++locations) {
         auto loc = locations.get();
         auto k = loc.first;
         auto pos = loc.second;
-        // DEBUG:
-        std::cerr << "file=" << file << " k=" << k << " pos=" << pos << std::endl;
-        auto umi_seen_copy = umi_seen; // Copy; use umi_seen_copy for querying (we don't want to overwrite umi_seen while we're still using it)
+        if (skip_no_hits && hits->heads[pos] == -1) {
+          continue;
+        }
         if (do_extract) { // Do UMI extraction based on location (iterate through all UMI-anchored locations up through current pos)
+          umi_anchors.snapshot(); // (Anchors opened or closed while processing this position aren't seen by it)
           while (it_umi_loc != umi_loc_map.end() && it_umi_loc->first.first <= file && it_umi_loc->first.second <= pos) {
             if (it_umi_loc->first.first == file) {
               if (it_umi_loc->first.second == -1) {
-                umi_loc_check_end = true;
+                umi_loc_end = &it_umi_loc->second;
               } else {
-                doUMIExtraction(seq, it_umi_loc->first.second, 0, file, readLength, umi_seen, umi_seen_copy, umi_data, 0, 0, std::make_pair(file, it_umi_loc->first.second));
-                if (pos != it_umi_loc->first.second) { // Don't update copy if we're at the current pos (since we don't want the current location, which may be added/deleted in umi_seen, to affect the barcode-based UMI extraction)
-                  umi_seen_copy = umi_seen;
+                doUMIExtraction(seq, it_umi_loc->first.second, 0, file, readLength, umi_anchors, umi_data, 0, 0, &it_umi_loc->second);
+                if (pos != it_umi_loc->first.second) { // Don't take a snapshot if we're at the current pos (since we don't want the current location, which may close anchors, to affect the barcode-based UMI extraction)
+                  umi_anchors.snapshot();
                 }
               }
             }
@@ -2799,35 +4706,62 @@ struct SplitCode {
             continue;
           }
           if (search_extra_after2 != 0 && pos-search_after_start >= search_extra_after2) {
-            continue; // Could break here?
+            break; // Past the window (nothing else can be found since only the tag name or group being searched for is accepted)
+          }
+          if (k > search_max_k) {
+            continue; // (Searching from k only finds sequences of length k or longer)
           }
         }
         uint32_t tag_id;
         int error;
-        std::cerr << "ATTEMPT_FETCH_TAG" << k << " " << pos << std::endl;
         if (getTag(seq, tag_id, file, pos, k, error, readLength, look_for_initiator, 
                    search_tag_name_after, search_group_after, search_id_after,
-                   search_tag_before, group_curr, name_id_curr, search_after_start)) {
-          std::cerr << "getTag(): " << tag_id << std::endl;
+                   search_tag_before, group_curr, name_id_curr, search_after_start, hits, &m)) {
           look_for_initiator = false;
           auto& tag = tags_vec[tag_id];
-          if (tag.min_finds > 0) {
-            min_finds[tag_id]--;
+          int tag_n = 0; // Previous finds of the tag in this read
+          if (tag.min_finds > 0 || tag.max_finds > 0) {
+            tag_n = m.tag_finds[tag_id]++;
+            if (tag_n == 0) {
+              m.tags_found.push_back(tag_id);
+            }
+            n_min_met += (tag_n+1 == tag.min_finds);
           }
-          if (min_finds_group.find(tag.group) != min_finds_group.end()) {
-            min_finds_group[tag.group]--;
+          bool group_limited = tag.group < group_min_finds.size() && (group_min_finds[tag.group] > 0 || group_max_finds[tag.group] > 0);
+          if (group_limited) {
+            int group_n = m.group_finds[tag.group]++;
+            if (group_n == 0) {
+              m.groups_found.push_back(tag.group);
+            }
+            n_min_met += (group_n+1 == group_min_finds[tag.group]);
           }
           if (tag.max_finds > 0) {
-            if (max_finds[tag_id]-- <= 0) {
+            if (tag_n >= tag.max_finds) {
               continue; // maxFinds exceeded; just continue
             }
+            if (use_file_caps && tag_n+1 == tag.max_finds && tag_caps[tag_id]) {
+              caps_left[file]--;
+            }
           }
-          if (max_finds_group.find(tag.group) != max_finds_group.end()) {
-            if (max_finds_group[tag.group]-- <= 0) {
+          if (group_limited && group_max_finds[tag.group] > 0) {
+            int group_n = m.group_kept[tag.group]++;
+            if (group_n >= group_max_finds[tag.group]) {
               continue; // maxFindsG exceeded; just continue
             }
+            if (use_file_caps && group_n+1 == group_max_finds[tag.group]) {
+              auto it_files = group_cap_files.find(tag.group);
+              if (it_files != group_cap_files.end()) {
+                for (int f : it_files->second) {
+                  caps_left[f]--;
+                }
+              }
+            }
           }
           // OK, we have found the tag and it's legit (e.g. it doesn't exceed maxFinds); let's process it
+          found_in_file = true;
+          if (found_locations) {
+            found_locations->push_back(std::make_pair(file, std::make_pair(pos, pos+k)));
+          }
           search_group_after = false; // reset
           search_tag_name_after = false; // reset
           search_tag_before = true;
@@ -2843,6 +4777,7 @@ struct SplitCode {
             search_id_after = tag.id_after;
             search_extra_after = tag.extra_after;
             search_extra_after2 = tag.extra_after2;
+            search_max_k = tag.has_after_group ? group_max_k[tag.id_after] : name_max_k[tag.id_after];
           }
           if (!tag.not_include_in_barcode) {
             int sz = results.name_ids.size();
@@ -2854,12 +4789,24 @@ struct SplitCode {
             if (check_group) {
               group_v.push_back(tag.group);
             }
+            if (prune) {
+              if (keep_check) {
+                keep_node = keep_trie.next(keep_node, tag.name_id);
+              }
+              if (keep_check_group) {
+                keep_node_group = keep_trie_group.next(keep_node_group, tag.group);
+              }
+              if (keep_node == -1 || keep_node_group == -1) {
+                results.discard = true; // Whatever else is found, the read can't end up in the keep list
+                return;
+              }
+            }
           }
           if (!tag.substitution.empty()) { // Do substitution
             results.modsubs.push_back(std::make_pair(file, std::make_pair(pos,std::make_pair(tag.substitution, k))));
           }
           if (do_extract) { // UMI extraction
-            doUMIExtraction(seq, pos, k, file, readLength, umi_seen, umi_seen_copy, umi_data, tag.name_id, tag.group);
+            doUMIExtraction(seq, pos, k, file, readLength, umi_anchors, umi_data, tag.name_id, tag.group);
           }
           if (tag.trim == left) {
             left_trim = pos+k+tag.trim_offset;
@@ -2867,7 +4814,6 @@ struct SplitCode {
             results.tag_trimmed_left.resize(jmax, {{0,0}, {0,0}});
             results.tag_trimmed_left[file].first = std::make_pair(tag.name_id, left_trim);
             results.tag_trimmed_left[file].second = std::make_pair(k, error);
-            std::cerr << "getTag_left_trim: " << tag_id << " left_trim:" << left_trim << " k:" << k << " error:" << error << " file:" << file << std::endl;
           } else if (tag.trim == right && !right_trim_found) {
             right_trim = (readLength-pos)+tag.trim_offset;
             right_trim = std::min(right_trim, readLength);
@@ -2880,25 +4826,32 @@ struct SplitCode {
           if (tag.terminator) {
             break; // End the search for the current (j'th) read file's sequence
           }
-          locations.setJump(k);
+          if (use_file_caps && caps_left[file] == 0) {
+            break; // Every tag that could still be found in this file has used up its maxFinds/maxFindsG
+          }
+          locations.setJump(tag.has_after ? k+tag.extra_after : k); // (Go straight to the start of the window when searching for what comes after)
         }
       }
+      if (learned_file && !found_in_file) {
+        results.learned_miss = file;
+        return;
+      }
       // Go through the any remaining locations-based extraction necessary for the current file
       if (do_extract) {
-        auto umi_seen_copy = umi_seen;
+        umi_anchors.snapshot();
         while (it_umi_loc != umi_loc_map.end() && it_umi_loc->first.first <= file) {
           if (it_umi_loc->first.first == file) {
             if (it_umi_loc->first.second == -1) {
-              umi_loc_check_end = true;
+              umi_loc_end = &it_umi_loc->second;
             } else {
-              doUMIExtraction(seq, it_umi_loc->first.second, 0, file, readLength, umi_seen, umi_seen_copy, umi_data, 0, 0, std::make_pair(file, it_umi_loc->first.second));
+              doUMIExtraction(seq, it_umi_loc->first.second, 0, file, readLength, umi_anchors, umi_data, 0, 0, &it_umi_loc->second);
             }
           }
-          umi_seen_copy = umi_seen;
+          umi_anchors.snapshot();
           it_umi_loc++;
         }
-        if (umi_loc_check_end) { // If we have -1 (denoting the end of the read)
-          doUMIExtraction(seq, -1, 0, file, readLength, umi_seen, umi_seen_copy, umi_data, 0, 0, std::make_pair(file, -1));
+        if (umi_loc_end != nullptr) { // If we have -1 (denoting the end of the read)
+          doUMIExtraction(seq, -1, 0, file, readLength, umi_anchors, umi_data, 0, 0, umi_loc_end);
         }
       }
       // Modify (trim) the reads
@@ -2940,17 +4893,8 @@ struct SplitCode {
         }
       }
     }
-    for (auto& it : min_finds) {
-      if (it.second > 0) {
-        results.name_ids.clear(); // minFinds not met
-        break;
-      }
-    }
-    for (auto& it : min_finds_group) {
-      if (it.second > 0) {
-        results.name_ids.clear(); // minFindsG not met
-        break;
-      }
+    if (n_min_met < n_min_finds) {
+      results.name_ids.clear(); // minFinds or minFindsG not met
     }
     auto &u = results.name_ids;
     if (u.empty()) {
@@ -2985,6 +4929,18 @@ struct SplitCode {
       results.discard = true;
       return;
     }
+    if (radix_ids && !always_assign) {
+      int64_t id = 0;
+      auto& n_digits = m.radix_n_digits;
+      n_digits.assign(radix_groups.size(), 0);
+      for (auto name_id : u) {
+        const auto& d = radix_digits[name_id];
+        if (d.first != 0 && n_digits[d.first-1] < radix_groups[d.first-1].places.size()) {
+          id += d.second*radix_groups[d.first-1].places[n_digits[d.first-1]++];
+        }
+      }
+      results.id = id;
+    }
   }
   
   static void modifyRead(std::vector<std::pair<const char*, int>>& seqs, std::vector<std::pair<const char*, int>>& quals, int i, Results& results, bool edit_sub_len = false) {
@@ -3207,6 +5163,10 @@ struct SplitCode {
       if (u.empty() || !isAssigned(r) || always_assign) {
         continue;
       }
+      if (radix_ids) { // ID was already computed in processRead
+        radix_counts[r.id]++;
+        continue;
+      }
       int id = idmap_find(u);
       if (id != -1) {
         idcount[id]++;
@@ -3253,6 +5213,9 @@ struct SplitCode {
   
   std::string fetchNextBarcodeMapping() {
     int i = curr_barcode_mapping_i;
+    if (radix_ids) {
+      return fetchNextRadixBarcodeMapping();
+    }
     if (i >= idmap_getsize()) {
       curr_barcode_mapping_i = 0;
       return "";
@@ -3281,6 +5244,39 @@ struct SplitCode {
     return o;
   }
   
+  std::string fetchNextRadixBarcodeMapping() {
+    // Mapping is generated from the counts, in ID order, and each ID's digits are decoded back into tag names
+    int i = curr_barcode_mapping_i;
+    if (i == 0) {
+      radix_ids_sorted.clear();
+      radix_ids_sorted.reserve(radix_counts.size());
+      for (auto& it : radix_counts) {
+        radix_ids_sorted.push_back(it.first);
+      }
+      std::sort(radix_ids_sorted.begin(), radix_ids_sorted.end());
+    }
+    if (i >= (int)radix_ids_sorted.size()) {
+      curr_barcode_mapping_i = 0;
+      return "";
+    }
+    uint64_t id = radix_ids_sorted[i];
+    std::string barcode_str = "";
+    for (auto& g : radix_groups) {
+      for (auto place : g.places) {
+        uint64_t digit = (id / place) % (g.members.size()+1);
+        if (digit != 0) {
+          barcode_str += names[g.members[digit-1]] + ",";
+        }
+      }
+    }
+    if (!barcode_str.empty()) {
+      barcode_str.resize(barcode_str.size()-1);
+    }
+    std::string o = binaryToString(getID(id), getBarcodeLength()) + "\t" + barcode_str + "\t" + std::to_string(radix_counts[id]) + "\n";
+    ++curr_barcode_mapping_i;
+    return o;
+  }
+  
   int idmap_find(std::vector<uint32_t>& u) {
     if (use_16) {
       std::vector<uint16_t> u16(u.begin(), u.end());
@@ -3322,11 +5318,11 @@ struct SplitCode {
     if (barcode_prefix.empty()) {
       return id;
     }
-    return ((hashKmer(barcode_prefix) << (2*FAKE_BARCODE_LEN)) | id);
+    return ((hashKmer(barcode_prefix) << (2*barcode_id_len)) | id);
   }
   
   int getBarcodeLength() {
-    return FAKE_BARCODE_LEN+barcode_prefix.length();
+    return barcode_id_len+barcode_prefix.length();
   }
   
   void setNumReads(size_t num_reads, size_t max_num_reads = 0) {
@@ -3460,8 +5456,24 @@ struct SplitCode {
   
   std::vector<SplitCodeTag> tags_vec;
   robin_hood::unordered_flat_map<SeqString, std::vector<tval>, SeqStringHasher> tags;
+  TagAutomaton tag_automaton; // Built in checkInit() when some file has tags without a fixed location
+  std::vector<bool> automaton_files; // Files whose reads are scanned with tag_automaton (or shift_and_matcher)
+  std::vector<bool> dynamic_files; // Files searched for tags that aren't in the tags map (align, partial, homopolymer and whitelist tags)
+  ShiftAndMatcher shift_and_matcher; // Built in checkInit() instead of tag_automaton for a small set of tags
+  size_t plan_size; // Number of (k-mer size, position) locations searched, over all files
+  double plan_compile_time; // Seconds checkInit() took to lay out the locations and expansions
+  std::vector<std::vector<KmerIndex>> kmer_indices; // [file][k]; built for k-mer sizes searched at fixed positions
+  std::vector<std::unique_ptr<std::vector<tval>>> kmer_vectors; // Tags map entries with some tags left out (pointed to by kmer_indices)
+  std::vector<TagFilter> tag_filters;
+  std::vector<AlignTag> align_tags;
+  std::vector<WhitelistIndex> whitelists;
+  std::vector<PartialTag> partial_tags;
+  std::vector<PolymerTag> polymer_tags;
+  std::vector<std::vector<std::pair<probe_type,uint32_t>>> dynamic_probes; // k -> (type, index into align_tags/partial_tags/polymer_tags/whitelists) probed with that k
   std::vector<std::string> names;
   std::vector<std::string> group_names;
+  robin_hood::unordered_flat_map<std::string,uint32_t> names_map; // name -> index in names
+  robin_hood::unordered_flat_map<std::string,uint32_t> group_names_map; // group name -> index in group_names
   
   std::vector<std::pair<uint32_t,std::pair<bool,std::string>>> before_after_vec;
   
@@ -3470,23 +5482,49 @@ struct SplitCode {
   robin_hood::unordered_node_map<std::vector<uint32_t>, int, VectorHasher> idmapinv;
   robin_hood::unordered_node_map<std::vector<uint16_t>, int, VectorHasher> idmapinv16;
   std::vector<uint32_t> idcount;
+  struct RadixGroup {
+    std::vector<uint64_t> places; // Place value of each of the group's digits
+    std::vector<uint32_t> members; // Name ids of digits 1,2,... (in group order)
+  };
+  std::vector<std::pair<uint32_t,uint32_t>> radix_digits; // [name id] -> 1 + index into radix_groups (0 if not in the barcode), digit (for radix_ids)
+  std::vector<RadixGroup> radix_groups;
+  robin_hood::unordered_flat_map<uint64_t,uint32_t> radix_counts; // ID -> number of reads
+  std::vector<uint64_t> radix_ids_sorted;
   std::unordered_map<std::vector<uint32_t>, std::string, VectorHasher> idmapinv_keep;
   std::unordered_map<std::vector<uint32_t>, int, VectorHasher> idmapinv_discard;
   std::unordered_map<std::vector<uint32_t>, std::string, VectorHasher> groupmapinv_keep;
   std::unordered_map<std::vector<uint32_t>, int, VectorHasher> groupmapinv_discard;
+  PrefixTrie keep_trie; // Prefixes of idmapinv_keep keys
+  PrefixTrie keep_trie_group; // Prefixes of groupmapinv_keep keys
   
   std::unordered_map<uint32_t,int> min_finds_map;
   std::unordered_map<uint32_t,int> max_finds_map;
   std::unordered_map<uint32_t,int> min_finds_group_map;
   std::unordered_map<uint32_t,int> max_finds_group_map;
+  std::vector<int> group_min_finds; // Dense copies of min_finds_group_map and max_finds_group_map (0 = no limit)
+  std::vector<int> group_max_finds;
+  int n_min_finds; // Number of minFinds and minFindsG limits (all must be met for a read to be assigned)
+  bool count_finds; // Some tag or group has a minFinds/maxFinds limit
   std::vector<bool> initiator_files;
+  std::vector<int> name_max_k;
+  std::vector<int> group_max_k;
+  std::vector<int> file_caps; // Number of maxFinds/maxFindsG limits that must be used up before the search of a file can stop (-1 = can't stop early)
+  std::vector<bool> tag_caps; // Tags whose maxFinds counts toward file_caps
+  std::unordered_map<uint32_t,std::vector<int>> group_cap_files; // Group -> files whose file_caps its maxFindsG counts toward
+  bool use_file_caps;
   
   std::unordered_map<uint32_t,std::vector<UMI>> umi_name_map;
   std::unordered_map<uint32_t,std::vector<UMI>> umi_group_map;
+  std::vector<UMI> umi_actions; // The UMIs of tag name i are umi_actions[umi_name_start[i]] up to umi_actions[umi_name_start[i+1]] (likewise for groups)
+  std::vector<uint32_t> umi_name_start;
+  std::vector<uint32_t> umi_group_start;
   std::map<std::pair<int,int>,std::vector<UMI>> umi_loc_map; // hash for pair not defined for unordered_map
   std::vector<std::string> umi_names;
   
   std::vector<std::vector<std::pair<int,int>>> kmer_size_locations;
+  std::vector<std::unique_ptr<std::atomic<const CompiledPlan*>[]>> compiled_locations; // [file][rlen] -> plan from compiledLocations()
+  std::vector<std::unique_ptr<CompiledPlan>> compiled_locations_storage;
+  std::mutex compiled_locations_mutex;
   
   std::string barcode_prefix;
   std::string trim_5_str, trim_3_str;
@@ -3502,6 +5540,23 @@ struct SplitCode {
   
   size_t summary_n_reads_filtered;
   size_t summary_n_reads_filtered_assigned;
+  
+  size_t learn_n; // Number of reads to learn tag locations from (0 = don't learn)
+  int learn_margin;
+  size_t learn_n_seen;
+  std::atomic<bool> learned;
+  std::atomic<size_t> learn_n_fallback; // Reads that needed a full search after locations were learned
+  bool results_cacheable;
+  std::vector<int> cache_region; // Number of bases at the start of each read that results can depend on (when results_cacheable)
+  std::atomic<size_t> cache_n_hits;
+  std::atomic<size_t> cache_n_lookups;
+  std::mutex learn_mutex;
+  std::vector<std::vector<size_t>> learn_hist; // [file][start position] = number of tags found there while learning
+  std::vector<std::vector<size_t>> learn_hist_end; // [file][end position]
+  std::vector<std::vector<std::pair<int,int>>> learned_kmer_size_locations;
+  std::unique_ptr<std::atomic<bool>[]> learned_files; // Files searched using learned_kmer_size_locations (until too many of their reads need full searches)
+  std::vector<size_t> learn_file_searched; // [file] = reads searched using the learned locations
+  std::vector<size_t> learn_file_fallback; // [file] = those of them that needed a full search because nothing was found in the file
   std::vector<size_t> summary_n_bases_total_trimmed_5, summary_n_bases_total_trimmed_3, summary_n_reads_total_trimmed_5, summary_n_reads_total_trimmed_3;
   std::vector<size_t> summary_n_bases_qual_trimmed_5, summary_n_bases_qual_trimmed_3, summary_n_reads_qual_trimmed_5, summary_n_reads_qual_trimmed_3;
   std::vector<size_t> summary_n_bases_total_trimmed_5_assigned, summary_n_bases_total_trimmed_3_assigned, summary_n_reads_total_trimmed_5_assigned, summary_n_reads_total_trimmed_3_assigned;
@@ -3519,6 +5574,10 @@ struct SplitCode {
   bool keep_check_group;
   bool always_assign;
   bool random_replacement;
+  bool radix_ids;
+  int barcode_id_len; // Bases of the final barcode that hold the ID (FAKE_BARCODE_LEN unless mixed-radix IDs need more)
+  bool discarded_unused;
+  bool keep_pruning;
   bool do_extract;
   bool extract_no_chain;
   bool use_16;
@@ -3533,6 +5592,14 @@ struct SplitCode {
   int curr_barcode_mapping_i;
   int curr_umi_id_i;
   static const int MAX_K = 32;
+  static const size_t PREFETCH_READS = 16; // Reads per group in processBatch()
+  static const int PREFETCH_PROBES = 4; // Lookups prefetched per read file
+  static const int MAX_COMPILED_RLEN = 1024; // Longest read length that search plans are compiled for
+  static const size_t CACHE_TRIAL_LOOKUPS = 10000; // Lookups after which a result cache that rarely hits is turned off
+  static constexpr double CACHE_MIN_HIT_RATE = 0.1;
+  static constexpr double LEARN_OUTLIER_FRACTION = 0.001; // Fraction of learned tag locations on each end of a window that can be left out
+  static const size_t LEARN_TRIAL_READS = 10000; // Reads searched using a file's learned locations before its full search rate is checked
+  static constexpr double LEARN_MAX_FALLBACK_RATE = 0.25; // Full search rate above which a file goes back to its full search plan
   static const size_t FAKE_BARCODE_LEN = 16;
   static const char QUAL = 'K';
 };
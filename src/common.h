@@ -15,6 +15,7 @@ struct ProgramOptions {
   int input_interleaved_nfiles;
   int quality_trimming_threshold;
   int64_t max_num_reads;
+  size_t cache_size;
   bool extract_no_chain;
   bool output_fasta;
   bool no_output;
@@ -39,6 +40,7 @@ struct ProgramOptions {
   bool quality_trimming_pre;
   bool quality_trimming_naive;
   bool phred64;
+  bool radix_ids;
   std::vector<std::string> files;
   std::vector<std::string> output_files;
   std::string outputb_file;
@@ -72,6 +74,8 @@ struct ProgramOptions {
   std::string barcode_prefix;
   std::string summary_file;
   std::string subs_str;
+  std::string match_str;
+  std::string learn_str;
   std::string select_output_files_str;
   std::vector<bool> select_output_files;
   std::vector<std::string> sam_tags;
@@ -82,6 +86,7 @@ struct ProgramOptions {
     input_interleaved_nfiles(0),
     quality_trimming_threshold(-1),
     max_num_reads(0),
+    cache_size(0),
     extract_no_chain(false),
     output_fasta(false),
     no_output(false),
@@ -105,7 +110,8 @@ struct ProgramOptions {
     quality_trimming_3(false),
     quality_trimming_pre(false),
     quality_trimming_naive(false),
-    phred64(false)
+    phred64(false),
+    radix_ids(false)
   {
     const char* sam_tags_default[3] = {"CB:Z", "RX:Z:", "BI:i:"};
     sam_tags.push_back(std::string(sam_tags_default[0]));
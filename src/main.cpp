@@ -75,6 +75,10 @@ void usage() {
        << "-U, --subs       Specifies sequence to substitute tag with when found in read (. = original sequence) (comma-separated)" << endl
        << "-z, --partial5   Specifies tag may be truncated at the 5′ end (comma-separated min_match:mismatch_freq)" << endl
        << "-Z, --partial3   Specifies tag may be truncated at the 3′ end (comma-separated min_match:mismatch_freq)" << endl
+       << "-W, --match      How errors are matched for each tag (comma-separated; neighbors = enumerate error sequences (default)," << endl
+       << "                 align = edit distance alignment, using the total distance; for long tags with indels" << endl
+       << "                 (a true edit distance: at distances of 2 or more, it can match combinations of substitutions and indels that neighbors doesn't)," << endl
+       << "                 whitelist = half-sequence index; for large barcode whitelists with mismatches only)" << endl
        << "Read modification and extraction options (for configuring on the command-line):" << endl
        << "-x, --extract    Pattern(s) describing how to extract UMI and UMI-like sequences from reads" << endl
        << "                 (E.g. {bc}2<umi_1[5]> means extract a 5-bp UMI sequence, called umi_1, 2 base pairs following the tag named 'bc')" << endl
@@ -119,11 +123,17 @@ void usage() {
        << "                 (default: 1) (specify 2 for paired-end)" << endl
        << "-n, --numReads   Maximum number of reads to process from supplied input" << endl
        << "-A, --append     An existing mapping file that will be added on to" << endl
+       << "    --radix-ids  Compute final barcode IDs arithmetically from which tags of each group were found (requires every" << endl
+       << "                 tag in the final barcode to be in a group with a maxFindsG; only the order within a group is kept)" << endl
        << "-k, --keep       File containing a list of arrangements of tag names to keep" << endl
        << "-r, --remove     File containing a list of arrangements of tag names to remove/discard" << endl
        << "-y, --keep-grp   File containing a list of arrangements of tag groups to keep" << endl
        << "-Y, --remove-grp File containing a list of arrangements of tag groups to remove/discard" << endl
        << "-t, --threads    Number of threads to use" << endl
+       << "-C, --cache      Number of recent results each thread remembers, reused for reads with the same bases where tags are searched" << endl
+       << "                 (only used when every tag has a fixed location and there's no extraction, quality trimming, or --learn)" << endl
+       << "-K, --learn      Number of reads to learn tag locations from before restricting the search to them" << endl
+       << "                 (format: reads[:margin]) (default margin: 5) (reads with nothing found there are searched in full)" << endl
        << "-T, --trim-only  All reads are assigned and trimmed regardless of what tags are present" << endl
        << "-s, --summary    File where summary statistics will be written to" << endl
        << "-h, --help       Displays usage information" << endl
@@ -155,8 +165,9 @@ void ParseOptions(int argc, char **argv, ProgramOptions& opt) {
   int qtrim_pre_flag = 0;
   int qtrim_naive_flag = 0;
   int phred64_flag = 0;
+  int radix_ids_flag = 0;
 
-  const char *opt_string = "t:N:n:b:d:i:l:f:F:e:c:o:O:u:m:k:r:A:L:R:E:g:y:Y:j:J:a:v:z:Z:5:3:w:x:P:q:s:S:M:U:Tph";
+  const char *opt_string = "t:N:n:b:d:i:l:f:F:e:c:o:O:u:m:k:r:A:L:R:E:g:y:Y:j:J:a:v:z:Z:W:K:C:5:3:w:x:P:q:s:S:M:U:Tph";
   static struct option long_options[] = {
     // long args
     {"version", no_argument, &version_flag, 1},
@@ -180,11 +191,14 @@ void ParseOptions(int argc, char **argv, ProgramOptions& opt) {
     {"qtrim-pre", no_argument, &qtrim_pre_flag, 1},
     {"qtrim-naive", no_argument, &qtrim_naive_flag, 1},
     {"phred64", no_argument, &phred64_flag, 1},
+    {"radix-ids", no_argument, &radix_ids_flag, 1},
     // short args
     {"help", no_argument, 0, 'h'},
     {"pipe", no_argument, 0, 'p'},
     {"trim-only", no_argument, 0, 'T'},
     {"threads", required_argument, 0, 't'},
+    {"learn", required_argument, 0, 'K'},
+    {"cache", required_argument, 0, 'C'},
     {"nFastqs", required_argument, 0, 'N'},
     {"numReads", required_argument, 0, 'n'},
     {"tags", required_argument, 0, 'b'},
@@ -203,6 +217,7 @@ void ParseOptions(int argc, char **argv, ProgramOptions& opt) {
     {"previous", required_argument, 0, 'v'},
     {"partial5", required_argument, 0, 'z'},
     {"partial3", required_argument, 0, 'Z'},
+    {"match", required_argument, 0, 'W'},
     {"before", required_argument, 0, 'v'},
     {"config", required_argument, 0, 'c'},
     {"output", required_argument, 0, 'o'},
@@ -338,6 +353,18 @@ void ParseOptions(int argc, char **argv, ProgramOptions& opt) {
       stringstream(optarg) >> opt.partial3_str;
       break;
     }
+    case 'W': {
+      stringstream(optarg) >> opt.match_str;
+      break;
+    }
+    case 'K': {
+      stringstream(optarg) >> opt.learn_str;
+      break;
+    }
+    case 'C': {
+      stringstream(optarg) >> opt.cache_size;
+      break;
+    }
     case 'c': {
       stringstream(optarg) >> opt.config_file;
       break;
@@ -517,6 +544,9 @@ void ParseOptions(int argc, char **argv, ProgramOptions& opt) {
   if (phred64_flag) {
     opt.phred64 = true;
   }
+  if (radix_ids_flag) {
+    opt.radix_ids = true;
+  }
   
   for (int i = optind; i < argc; i++) {
     opt.files.push_back(argv[i]);
@@ -567,6 +597,39 @@ bool CheckOptions(ProgramOptions& opt, SplitCode& sc) {
     std::cerr << ERROR_STR << " --numReads must be a positive number" << std::endl;
     ret = false;
   }
+  if (!opt.learn_str.empty()) {
+    size_t learn_n = 0;
+    int learn_margin = 5;
+    auto colon_pos = opt.learn_str.find(':');
+    try {
+      std::string learn_n_str = opt.learn_str.substr(0, colon_pos);
+      size_t n_chars;
+      learn_n = std::stoull(learn_n_str, &n_chars);
+      if (n_chars != learn_n_str.length()) {
+        learn_n = 0;
+      }
+      if (colon_pos != std::string::npos) {
+        learn_margin = std::stoi(opt.learn_str.substr(colon_pos+1));
+      }
+    } catch (std::exception &e) {
+      learn_n = 0;
+    }
+    if (learn_n == 0 || learn_margin < 0) {
+      std::cerr << ERROR_STR << " --learn must be a positive number of reads optionally followed by a non-negative margin (e.g. 100000:5)" << std::endl;
+      ret = false;
+    } else {
+      sc.setLearning(learn_n, learn_margin);
+    }
+  }
+  sc.setDiscardedUnused(opt.unassigned_files.empty() && !opt.mod_names && !opt.seq_names);
+  if (opt.radix_ids) {
+    if (!opt.append_file.empty()) {
+      std::cerr << ERROR_STR << " --radix-ids cannot be used with --append" << std::endl;
+      ret = false;
+    } else {
+      sc.setRadixIds(true);
+    }
+  }
   if (opt.mapping_file.empty() && !opt.trim_only) {
     std::cerr << ERROR_STR << " --mapping must be provided" << std::endl;
     ret = false;
@@ -705,6 +768,7 @@ bool CheckOptions(ProgramOptions& opt, SplitCode& sc) {
     stringstream ss13(opt.partial5_str);
     stringstream ss14(opt.partial3_str);
     stringstream ss15(opt.subs_str);
+    stringstream ss16(opt.match_str);
     while (ss1.good()) {
       uint16_t max_finds = 0;
       uint16_t min_finds = 0;
@@ -720,6 +784,8 @@ bool CheckOptions(ProgramOptions& opt, SplitCode& sc) {
       string partial5_str = "";
       string partial3_str = "";
       string subs_str = "";
+      string match_str = "";
+      SplitCode::matcher match;
       int partial5_min_match, partial3_min_match;
       double partial5_mismatch_freq, partial3_mismatch_freq;
       bool trim_left, trim_right;
@@ -928,7 +994,20 @@ bool CheckOptions(ProgramOptions& opt, SplitCode& sc) {
         }
         getline(ss15, subs_str, ',');
       }
-      if (!sc.addTag(bc, name.empty() ? bc : name, group, mismatch, indel, total_dist, file, pos_start, pos_end, max_finds, min_finds, exclude, trim_dir, trim_offset, after_str, before_str, partial5_min_match, partial5_mismatch_freq, partial3_min_match, partial3_mismatch_freq, subs_str)) {
+      if (!opt.match_str.empty()) {
+        if (!ss16.good()) {
+          std::cerr << ERROR_STR << " Number of values in --match is less than that in --tags" << std::endl;
+          ret = false;
+          break;
+        }
+        getline(ss16, match_str, ',');
+      }
+      if (!SplitCode::parseMatchStr(match_str, match)) {
+        std::cerr << ERROR_STR << " --match is invalid" << std::endl;
+        ret = false;
+        break;
+      }
+      if (!sc.addTag(bc, name.empty() ? bc : name, group, mismatch, indel, total_dist, file, pos_start, pos_end, max_finds, min_finds, exclude, trim_dir, trim_offset, after_str, before_str, partial5_min_match, partial5_mismatch_freq, partial3_min_match, partial3_mismatch_freq, subs_str, match)) {
         std::cerr << ERROR_STR << " Could not finish processing supplied tags list" << std::endl;
         ret = false;
         break;
@@ -990,6 +1069,10 @@ bool CheckOptions(ProgramOptions& opt, SplitCode& sc) {
       std::cerr << ERROR_STR << " Number of values in --subs is greater than that in --tags" << std::endl;
       ret = false;
     }
+    if (ret && !opt.match_str.empty() && ss16.good()) {
+      std::cerr << ERROR_STR << " Number of values in --match is greater than that in --tags" << std::endl;
+      ret = false;
+    }
   } else if (!opt.distance_str.empty()) {
     std::cerr << ERROR_STR << " --distances cannot be supplied unless --tags is" << std::endl;
     ret = false;
@@ -1032,6 +1115,9 @@ bool CheckOptions(ProgramOptions& opt, SplitCode& sc) {
   } else if (!opt.subs_str.empty()) {
     std::cerr << ERROR_STR << " --subs cannot be supplied unless --tags is" << std::endl;
     ret = false;
+  } else if (!opt.match_str.empty()) {
+    std::cerr << ERROR_STR << " --match cannot be supplied unless --tags is" << std::endl;
+    ret = false;
   } else if (!opt.config_file.empty()) {
     ret = ret && sc.addTags(opt.config_file);
   }
@@ -1121,6 +1207,10 @@ bool CheckOptions(ProgramOptions& opt, SplitCode& sc) {
     sc.checkInit();
   }
   
+  if (ret && opt.radix_ids && !sc.usesRadixIds()) {
+    ret = false; // (The reason was already reported)
+  }
+  
   return ret;
 }
 
@@ -1168,11 +1258,17 @@ int main(int argc, char *argv[]) {
     }
   }
   
+  if (opt.cache_size != 0 && !sc.resultsCacheable()) {
+    std::cerr << "Warning: --cache is not used because some tags don't have fixed locations or extraction/quality trimming/--learn is on" << std::endl;
+  }
   if (opt.verbose) {
     std::cerr << "* Using a list of " << sc.getNumTagsOriginallyAdded() << 
       " tags (vector size: " << sc.getNumTags() << 
       "; map size: " << pretty_num(sc.getMapSize()) << 
       "; num elements in map: " << pretty_num(sc.getMapSize(false)) << ")" << std::endl;
+    std::stringstream compile_time;
+    compile_time << std::fixed << std::setprecision(3) << sc.getPlanCompileTime();
+    std::cerr << "* Search plan: " << pretty_num(sc.getPlanSize()) << " locations (compiled in " << compile_time.str() << "s)" << std::endl;
   }
   MasterProcessor MP(sc, opt);
   int numreads = ProcessReads(MP, opt);